@@ -1,31 +1,173 @@
 #include <iostream>
 #include <chrono>
-#include <windows.h>
 #include <map>
 #include <random>
 #include <csignal>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <atomic>
+#include "app/app.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
-extern int get_cache_miss();
-extern int get_cache_hit();
-extern void reset_cache_stats();
-extern void free_all_cache_blocks();
+using namespace std;
 
-extern int get_rand_from_to(int min, int max);
+// Ввод-вывод без нашего кэша, с которым сравниваем.
+// На Windows - небуферизованный доступ, на POSIX - обычный доступ через page cache ядра.
+#ifdef _WIN32
+HANDLE raw_open(const char* path, bool writable) {
+    return CreateFile(path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                      writable ? FILE_SHARE_READ | FILE_SHARE_WRITE : FILE_SHARE_READ,
+                      NULL, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, NULL);
+}
+void raw_seek(HANDLE fd, long long offset) {
+    LARGE_INTEGER position;
+    position.QuadPart = offset;
+    SetFilePointerEx(fd, position, NULL, FILE_BEGIN);
+}
+void raw_read(HANDLE fd, void* buf, size_t count) {
+    DWORD bytesRead;
+    ReadFile(fd, buf, count, &bytesRead, NULL);
+}
+void raw_write(HANDLE fd, const void* buf, size_t count) {
+    DWORD bytesWritten;
+    WriteFile(fd, buf, count, &bytesWritten, NULL);
+}
+void raw_close(HANDLE fd) {
+    CloseHandle(fd);
+}
+// Создание (по возможности разреженного) файла заданного размера
+void create_sparse_file(const char* path, long long size) {
+    HANDLE fd = CreateFile(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    DWORD bytesReturned;
+    DeviceIoControl(fd, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &bytesReturned, NULL);
+    LARGE_INTEGER end;
+    end.QuadPart = size;
+    SetFilePointerEx(fd, end, NULL, FILE_BEGIN);
+    SetEndOfFile(fd);
+    CloseHandle(fd);
+}
+#else
+HANDLE raw_open(const char* path, bool writable) {
+    return open(path, writable ? O_RDWR : O_RDONLY);
+}
+void raw_seek(HANDLE fd, long long offset) {
+    lseek(fd, static_cast<off_t>(offset), SEEK_SET);
+}
+void raw_read(HANDLE fd, void* buf, size_t count) {
+    (void) !read(fd, buf, count);
+}
+void raw_write(HANDLE fd, const void* buf, size_t count) {
+    (void) !write(fd, buf, count);
+}
+void raw_close(HANDLE fd) {
+    close(fd);
+}
+void create_sparse_file(const char* path, long long size) {
+    HANDLE fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    (void) !ftruncate(fd, size);
+    close(fd);
+}
+#endif
 
-extern HANDLE lab2_open(const char *path);
-extern int lab2_close(HANDLE fd);
-extern ptrdiff_t lab2_read(HANDLE fd, void *buf, size_t count);
-extern ptrdiff_t lab2_write(HANDLE fd, const void *buf, size_t count);
-extern int lab2_lseek(HANDLE fd, int offset, int whence);
-extern int lab2_fsync(HANDLE fd);
 
-using namespace std;
+// Проверки тестов 5-24: несовпадение печатается, а число провалов становится кодом возврата
+int failures = 0;
+
+void check(bool condition, const char* what) {
+    if (!condition) {
+        failures++;
+        cout << "FAILED: " << what << "\n";
+    }
+}
+
+// Байт тестового файла по его смещению. Узор меняется и внутри блока, и от блока к блоку,
+// поэтому блок, прочитанный не с того места, не совпадёт
+char pattern_byte(long long offset) {
+    return static_cast<char>(offset * 7 + offset / 4093);
+}
+
+bool matches_pattern(const char* buf, long long offset, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (buf[i] != pattern_byte(offset + static_cast<long long>(i))) {
+            return false;
+        }
+    }
+    return true;
+}
 
-int main() {
-    bool test1 = false;
-    bool test2 = false;
-    bool test3 = false;
-    bool test4 = true;
+// Создание файла, заполненного узором pattern_byte
+void create_pattern_file(const char* path, long long size) {
+    ofstream out(path, ios::binary | ios::trunc);
+    vector<char> chunk(1024 * 1024);
+    for (long long offset = 0; offset < size; offset += static_cast<long long>(chunk.size())) {
+        const size_t count = static_cast<size_t>(min<long long>(static_cast<long long>(chunk.size()), size - offset));
+        for (size_t i = 0; i < count; ++i) {
+            chunk[i] = pattern_byte(offset + static_cast<long long>(i));
+        }
+        out.write(chunk.data(), static_cast<streamsize>(count));
+    }
+}
+
+// Чтение файла с диска в обход кэша (через стандартную библиотеку: без требований к выравниванию)
+vector<char> read_from_disk(const char* path, long long offset, size_t count) {
+    vector<char> data(count);
+    ifstream in(path, ios::binary);
+    in.seekg(offset);
+    in.read(data.data(), static_cast<streamsize>(count));
+    data.resize(static_cast<size_t>(in.gcount()));
+    return data;
+}
+
+// Номера тестов из командной строки. Без аргументов выполняются тесты 5-24:
+// тестам 1-4 нужны заранее подготовленные файлы
+bool test_selected(int argc, char** argv, int number) {
+    if (argc < 2) {
+        return number >= 5;
+    }
+    for (int i = 1; i < argc; ++i) {
+        if (atoi(argv[i]) == number) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char** argv) {
+    bool test1 = test_selected(argc, argv, 1);
+    bool test2 = test_selected(argc, argv, 2);
+    bool test3 = test_selected(argc, argv, 3);
+    bool test4 = test_selected(argc, argv, 4);
+    bool test5 = test_selected(argc, argv, 5);
+    bool test6 = test_selected(argc, argv, 6);
+    bool test7 = test_selected(argc, argv, 7);
+    bool test8 = test_selected(argc, argv, 8);
+    bool test9 = test_selected(argc, argv, 9);
+    bool test10 = test_selected(argc, argv, 10);
+    bool test11 = test_selected(argc, argv, 11);
+    bool test12 = test_selected(argc, argv, 12);
+    bool test13 = test_selected(argc, argv, 13);
+    bool test14 = test_selected(argc, argv, 14);
+    bool test15 = test_selected(argc, argv, 15);
+    bool test16 = test_selected(argc, argv, 16);
+    bool test17 = test_selected(argc, argv, 17);
+    bool test18 = test_selected(argc, argv, 18);
+    bool test19 = test_selected(argc, argv, 19);
+    bool test20 = test_selected(argc, argv, 20);
+    bool test21 = test_selected(argc, argv, 21);
+    bool test22 = test_selected(argc, argv, 22);
+    bool test23 = test_selected(argc, argv, 23);
+    bool test24 = test_selected(argc, argv, 24);
+    bool test25 = test_selected(argc, argv, 25);
+    bool test26 = test_selected(argc, argv, 26);
     std::chrono::time_point<std::chrono::high_resolution_clock> start;
     chrono::duration<double> duration;
     HANDLE fd;
@@ -39,13 +181,12 @@ int main() {
         cout << "Test #1 - Simple reading of the same large block " << times << " times\n\n";
 
         start = chrono::high_resolution_clock::now();
-        fd = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, NULL);
+        fd = raw_open(filename, false);
         for (int i = 0; i < times; ++i) {
-            DWORD bytesRead;
-            SetFilePointer(fd, 0, NULL, FILE_BEGIN);
-            ReadFile(fd, buf, 35000, &bytesRead, NULL);
+            raw_seek(fd, 0);
+            raw_read(fd, buf, 35000);
         }
-        CloseHandle(fd);
+        raw_close(fd);
         duration = chrono::high_resolution_clock::now() - start;
         cout << "Execution time without cache: " << duration.count() << " seconds.\n\n";
 
@@ -73,13 +214,12 @@ int main() {
         cout << "Test #2 - Reading a random block of data " << times << " times\n\n";
 
         start = chrono::high_resolution_clock::now();
-        fd = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, NULL);
+        fd = raw_open(filename, false);
         for (int i = 0; i < times; ++i) {
-            SetFilePointer(fd, get_rand_from_to(0, 300000), NULL, FILE_BEGIN);
-            DWORD bytesRead;
-            ReadFile(fd, buf, 9000, &bytesRead, NULL);
+            raw_seek(fd, get_rand_from_to(0, 300000));
+            raw_read(fd, buf, 9000);
         }
-        CloseHandle(fd);
+        raw_close(fd);
         duration = chrono::high_resolution_clock::now() - start;
         cout << "Execution time without cache: " << duration.count() << " seconds.\n\n";
 
@@ -107,16 +247,14 @@ int main() {
         cout << "Test #3 - Reading from an arbitrary location and writing the result to an arbitrary location in the file " << times << " times\n\n";
 
         start = chrono::high_resolution_clock::now();
-        fd = CreateFile(filename, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, NULL);
+        fd = raw_open(filename, true);
         for (int i = 0; i < times; ++i) {
-            SetFilePointer(fd, get_rand_from_to(0, 300000), NULL, FILE_BEGIN);
-            DWORD bytesRead;
-            ReadFile(fd, buf, 500, &bytesRead, NULL);
-            SetFilePointer(fd, get_rand_from_to(0, 300000), NULL, FILE_BEGIN);
-            DWORD bytesWritten;
-            WriteFile(fd, buf, 500, &bytesWritten, NULL);
+            raw_seek(fd, get_rand_from_to(0, 300000));
+            raw_read(fd, buf, 500);
+            raw_seek(fd, get_rand_from_to(0, 300000));
+            raw_write(fd, buf, 500);
         }
-        CloseHandle(fd);
+        raw_close(fd);
         duration = chrono::high_resolution_clock::now() - start;
         cout << "Execution time without cache: " << duration.count() << " seconds.\n\n";
 
@@ -172,5 +310,1380 @@ int main() {
         cout << "\n----------------------------------------\n\n\n";
     }
 
+
+    if (test5) {
+        const char* filename = "evict_test.bin";
+        const int block_size = 4096;
+        const int evictions = 20000;
+        char buf[1];
+
+        cout << "Test #5 - Cost of a miss with eviction as cache capacity grows\n\n";
+
+        for (int capacity = 256; capacity <= 65536; capacity *= 4) {
+            create_pattern_file(filename, static_cast<long long>(capacity + evictions) * block_size);
+            lab2_cache_resize(static_cast<size_t>(capacity) * block_size);
+            fd = lab2_open(filename);
+
+            // Заполняем кэш целиком
+            int mismatches = 0;
+            for (int i = 0; i < capacity; ++i) {
+                lab2_lseek(fd, static_cast<int64_t>(i) * block_size, 0);
+                mismatches += lab2_read(fd, buf, 1) != 1 || !matches_pattern(buf, static_cast<long long>(i) * block_size, 1);
+            }
+
+            // Каждое следующее чтение - промах с вытеснением
+            start = chrono::high_resolution_clock::now();
+            for (int i = capacity; i < capacity + evictions; ++i) {
+                lab2_lseek(fd, static_cast<int64_t>(i) * block_size, 0);
+                mismatches += lab2_read(fd, buf, 1) != 1 || !matches_pattern(buf, static_cast<long long>(i) * block_size, 1);
+            }
+            duration = chrono::high_resolution_clock::now() - start;
+            cout << "Capacity " << capacity << " blocks: "
+                 << duration.count() * 1e9 / evictions << " ns per evicting miss\n";
+            check(mismatches == 0, "test 5: data read after eviction");
+
+            lab2_close(fd);
+            free_all_cache_blocks();
+            reset_cache_stats();
+        }
+
+        remove(filename);
+        lab2_cache_resize(180 * block_size);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test6) {
+        const char* filename = "hit_test.bin";
+        const int block_size = 4096;
+        times = 1000000;
+        char buf[64];
+
+        cout << "Test #6 - Latency of a cache hit as the number of cached blocks grows\n\n";
+
+        for (int capacity = 256; capacity <= 65536; capacity *= 4) {
+            create_pattern_file(filename, static_cast<long long>(capacity) * block_size);
+            lab2_cache_resize(static_cast<size_t>(capacity) * block_size);
+            fd = lab2_open(filename);
+
+            // Загружаем в кэш все блоки файла
+            for (int i = 0; i < capacity; ++i) {
+                lab2_lseek(fd, static_cast<int64_t>(i) * block_size, 0);
+                lab2_read(fd, buf, 1);
+            }
+
+            // Заранее выбираем смещения, чтобы не измерять генератор случайных чисел
+            vector<long long> offsets(4096);
+            for (long long& offset : offsets) {
+                offset = static_cast<long long>(get_rand_from_to(0, capacity - 1)) * block_size
+                         + get_rand_from_to(0, block_size - 64);
+            }
+
+            start = chrono::high_resolution_clock::now();
+            for (int i = 0; i < times; ++i) {
+                lab2_lseek(fd, offsets[i % offsets.size()], 0);
+                lab2_read(fd, buf, 64);
+            }
+            duration = chrono::high_resolution_clock::now() - start;
+            cout << "Cached blocks " << capacity << ": "
+                 << duration.count() * 1e9 / times << " ns per hit\n";
+
+            // Сверка вне замера: те же смещения ещё раз
+            int mismatches = 0;
+            for (const long long offset : offsets) {
+                lab2_lseek(fd, offset, 0);
+                mismatches += lab2_read(fd, buf, 64) != 64 || !matches_pattern(buf, offset, 64);
+            }
+            check(mismatches == 0, "test 6: data of cache hits");
+
+            lab2_close(fd);
+            free_all_cache_blocks();
+            reset_cache_stats();
+        }
+
+        remove(filename);
+        lab2_cache_resize(180 * block_size);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test7) {
+        const int max_threads = 64;
+        const char* filename = "mt_test.bin";
+        const int block_size = 4096;
+        const int blocks_per_thread = 64;
+        const int reads_per_thread = 100000;
+
+        cout << "Test #7 - Throughput of cached reads from 1 to " << max_threads << " threads\n\n";
+
+        create_pattern_file(filename, static_cast<long long>(max_threads) * blocks_per_thread * block_size);
+        lab2_cache_resize(static_cast<size_t>(max_threads) * blocks_per_thread * block_size * 2);
+
+        atomic<int> mismatches {0};
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+            vector<thread> workers;
+            start = chrono::high_resolution_clock::now();
+            for (int t = 0; t < threads; ++t) {
+                // Каждый поток читает свою область файла через свой дескриптор
+                workers.emplace_back([t, filename, block_size, blocks_per_thread, reads_per_thread, &mismatches] {
+                    mt19937 rng(t);
+                    char thread_buf[64];
+                    HANDLE thread_fd = lab2_open(filename);
+                    for (int i = 0; i < reads_per_thread; ++i) {
+                        const int block = t * blocks_per_thread + static_cast<int>(rng() % blocks_per_thread);
+                        const long long offset = static_cast<long long>(block) * block_size
+                                                 + static_cast<int>(rng() % (block_size - 64));
+                        lab2_lseek(thread_fd, offset, 0);
+                        // Первый байт сверяется при каждом чтении, весь кусок - при каждом сотом
+                        if (lab2_read(thread_fd, thread_buf, 64) != 64 || thread_buf[0] != pattern_byte(offset)
+                            || (i % 100 == 0 && !matches_pattern(thread_buf, offset, 64))) {
+                            mismatches++;
+                        }
+                    }
+                    lab2_close(thread_fd);
+                });
+            }
+            for (thread& worker : workers) {
+                worker.join();
+            }
+            duration = chrono::high_resolution_clock::now() - start;
+            cout << threads << " threads: " << threads * reads_per_thread / duration.count() << " reads per second"
+                 << " (hits: " << get_cache_hit() << ", misses: " << get_cache_miss() << ")\n";
+
+            free_all_cache_blocks();
+            reset_cache_stats();
+        }
+        check(mismatches == 0, "test 7: data read by concurrent threads");
+
+        remove(filename);
+        lab2_cache_resize(180 * block_size);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test8) {
+        const char* filename = "readahead_test.bin";
+        const int block_size = 4096;
+        const int file_blocks = 16384;
+        vector<char> buf(block_size);
+
+        cout << "Test #8 - Sequential scan and random reads with readahead\n\n";
+
+        create_pattern_file(filename, static_cast<long long>(file_blocks) * block_size);
+        lab2_cache_resize(1024 * block_size);
+        fd = lab2_open(filename);
+
+        // Последовательный проход по файлу: окно упреждающего чтения растёт
+        int mismatches = 0;
+        start = chrono::high_resolution_clock::now();
+        lab2_lseek(fd, 0, 0);
+        for (int i = 0; i < file_blocks; ++i) {
+            mismatches += lab2_read(fd, buf.data(), block_size) != block_size
+                          || !matches_pattern(buf.data(), static_cast<long long>(i) * block_size, block_size);
+        }
+        duration = chrono::high_resolution_clock::now() - start;
+        cout << "Sequential: " << duration.count() * 1e9 / file_blocks << " ns per block"
+             << " (hits: " << get_cache_hit() << ", misses: " << get_cache_miss()
+             << ", readahead hits: " << get_readahead_hit() << ", readahead waste: " << get_readahead_waste() << ")\n";
+        check(mismatches == 0, "test 8: data of the sequential scan");
+        free_all_cache_blocks();
+        reset_cache_stats();
+
+        // Случайные чтения: окно схлопывается, лишних блоков почти нет
+        mismatches = 0;
+        start = chrono::high_resolution_clock::now();
+        for (int i = 0; i < file_blocks; ++i) {
+            const long long offset = static_cast<long long>(get_rand_from_to(0, file_blocks - 1)) * block_size;
+            lab2_lseek(fd, offset, 0);
+            mismatches += lab2_read(fd, buf.data(), block_size) != block_size
+                          || !matches_pattern(buf.data(), offset, block_size);
+        }
+        duration = chrono::high_resolution_clock::now() - start;
+        cout << "Random: " << duration.count() * 1e9 / file_blocks << " ns per block"
+             << " (hits: " << get_cache_hit() << ", misses: " << get_cache_miss()
+             << ", readahead hits: " << get_readahead_hit() << ", readahead waste: " << get_readahead_waste() << ")\n";
+        check(mismatches == 0, "test 8: data of random reads");
+
+        lab2_close(fd);
+
+        free_all_cache_blocks();
+        reset_cache_stats();
+        remove(filename);
+        lab2_cache_resize(180 * block_size);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test9) {
+        const char* filename = "prefetch_test.bin";
+        const int block_size = 4096;
+        const int range_blocks = 512;
+        vector<char> buf(block_size);
+
+        cout << "Test #9 - Random reads of a range with and without lab2_prefetch\n\n";
+
+        create_pattern_file(filename, static_cast<long long>(range_blocks) * block_size);
+        lab2_cache_resize(1024 * block_size);
+        fd = lab2_open(filename);
+        lab2_fadvise(fd, 0, 0, LAB2_ADV_RANDOM);
+
+        vector<int> order(range_blocks);
+        for (int i = 0; i < range_blocks; ++i) {
+            order[i] = i;
+        }
+        shuffle(order.begin(), order.end(), mt19937(1));
+
+        for (int prefetch = 0; prefetch <= 1; ++prefetch) {
+            int mismatches = 0;
+            start = chrono::high_resolution_clock::now();
+            if (prefetch) {
+                // Диапазон грузится в фоне, пока читатель занят своими блоками
+                lab2_prefetch(fd, 0, static_cast<size_t>(range_blocks) * block_size);
+            }
+            for (int block : order) {
+                lab2_lseek(fd, static_cast<int64_t>(block) * block_size, 0);
+                mismatches += lab2_read(fd, buf.data(), block_size) != block_size
+                              || !matches_pattern(buf.data(), static_cast<long long>(block) * block_size, block_size);
+            }
+            duration = chrono::high_resolution_clock::now() - start;
+            cout << (prefetch ? "With prefetch: " : "Cold: ") << duration.count() * 1e9 / range_blocks << " ns per block"
+                 << " (hits: " << get_cache_hit() << ", misses: " << get_cache_miss() << ")\n";
+            check(mismatches == 0, prefetch ? "test 9: data after lab2_prefetch" : "test 9: data of cold reads");
+            free_all_cache_blocks();
+            reset_cache_stats();
+        }
+
+        lab2_close(fd);
+
+        remove(filename);
+        lab2_cache_resize(180 * block_size);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test10) {
+        const char* filename = "batch_test.bin";
+        const int block_size = 4096;
+        const int range_blocks = 4096;
+        const int max_request_blocks = 16;
+        vector<char> buf(max_request_blocks * block_size);
+
+        cout << "Test #10 - Cold reads of one block and of " << max_request_blocks << " blocks per call\n\n";
+
+        create_pattern_file(filename, static_cast<long long>(range_blocks) * block_size);
+        lab2_cache_resize(range_blocks * block_size);
+        fd = lab2_open(filename);
+        // Без упреждающего чтения: в пакет промаха попадают только блоки самого запроса
+        lab2_fadvise(fd, 0, 0, LAB2_ADV_RANDOM);
+
+        for (int request_blocks = 1; request_blocks <= max_request_blocks; request_blocks *= max_request_blocks) {
+            vector<int> order(range_blocks / request_blocks);
+            for (int i = 0; i < static_cast<int>(order.size()); ++i) {
+                order[i] = i * request_blocks;
+            }
+            shuffle(order.begin(), order.end(), mt19937(1));
+
+            const size_t request_size = static_cast<size_t>(request_blocks) * block_size;
+            int mismatches = 0;
+            start = chrono::high_resolution_clock::now();
+            for (int block : order) {
+                lab2_lseek(fd, static_cast<int64_t>(block) * block_size, 0);
+                mismatches += lab2_read(fd, buf.data(), request_size) != static_cast<ptrdiff_t>(request_size)
+                              || !matches_pattern(buf.data(), static_cast<long long>(block) * block_size, request_size);
+            }
+            duration = chrono::high_resolution_clock::now() - start;
+            cout << request_blocks << " blocks per read: " << duration.count() * 1e9 / range_blocks << " ns per block"
+                 << " (hits: " << get_cache_hit() << ", misses: " << get_cache_miss() << ")\n";
+            check(mismatches == 0, "test 10: data of batched misses");
+            free_all_cache_blocks();
+            reset_cache_stats();
+        }
+
+        lab2_close(fd);
+
+        remove(filename);
+        lab2_cache_resize(180 * block_size);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test11) {
+        const char* filename = "writeback_test.bin";
+        const int block_size = 4096;
+        const int file_blocks = 2048;
+        const int cache_blocks = 256;
+        const int file_size = file_blocks * block_size;
+        times = 50000;
+        char buf[500];
+
+        cout << "Test #11 - Random reads and writes with and without background writeback\n\n";
+
+        lab2_cache_resize(cache_blocks * block_size);
+        for (int background = 0; background <= 1; ++background) {
+            // Доля 100% недостижима, а возраст 0 не ограничен - фоновая запись выключена
+            const Lab2WritebackConfig config = {background ? 10u : 100u, background ? 30000u : 0u, 1024 * 1024};
+            lab2_set_writeback(&config);
+            create_pattern_file(filename, file_size);
+            // Ожидаемое содержимое файла: узор, поверх которого легли записи
+            vector<char> expected(file_size);
+            for (int i = 0; i < file_size; ++i) {
+                expected[i] = pattern_byte(i);
+            }
+
+            int mismatches = 0;
+            start = chrono::high_resolution_clock::now();
+            fd = lab2_open(filename);
+            for (int i = 0; i < times; ++i) {
+                // Запись сосредоточена в горячей четверти файла, чтение идёт по всему файлу
+                const int write_offset = get_rand_from_to(0, file_blocks / 4 * block_size - 500);
+                memset(buf, 'a' + i % 26, sizeof(buf));
+                lab2_lseek(fd, write_offset, 0);
+                lab2_write(fd, buf, 500);
+                memcpy(expected.data() + write_offset, buf, 500);
+                const int read_offset = get_rand_from_to(0, file_size - 500);
+                lab2_lseek(fd, read_offset, 0);
+                mismatches += lab2_read(fd, buf, 500) != 500 || memcmp(buf, expected.data() + read_offset, 500) != 0;
+            }
+            duration = chrono::high_resolution_clock::now() - start;
+            cout << (background ? "Background writeback: " : "Writeback on eviction only: ") << duration.count() << " seconds"
+                 << " (hits: " << get_cache_hit() << ", misses: " << get_cache_miss()
+                 << ", evictions that waited for a write: " << get_dirty_evictions() << ")\n";
+            lab2_close(fd);
+            check(mismatches == 0, "test 11: reads see earlier writes");
+            check(read_from_disk(filename, 0, file_size) == expected, "test 11: file on disk after close");
+            free_all_cache_blocks();
+            reset_cache_stats();
+        }
+
+        const Lab2WritebackConfig defaults = {10, 30000, 1024 * 1024};
+        lab2_set_writeback(&defaults);
+        remove(filename);
+        lab2_cache_resize(180 * block_size);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test12) {
+        const char* filename = "coalesce_test.bin";
+        const int block_size = 4096;
+        const int file_blocks = 2048;
+        const int file_size = file_blocks * block_size;
+        const int chunk_size = 64 * 1024;
+        vector<char> buf(chunk_size, 'x');
+
+        cout << "Test #12 - Flushing sequentially written blocks by fsync with and without write coalescing\n\n";
+
+        lab2_cache_resize(2 * file_size);
+        for (size_t max_write : {static_cast<size_t>(block_size), static_cast<size_t>(1024 * 1024)}) {
+            // Фоновая запись выключена: все блоки пишет lab2_fsync
+            const Lab2WritebackConfig config = {100, 0, max_write};
+            lab2_set_writeback(&config);
+            create_sparse_file(filename, file_size);
+
+            fd = lab2_open(filename);
+            for (int written = 0; written < file_size; written += chunk_size) {
+                lab2_write(fd, buf.data(), chunk_size);
+            }
+            // Замеряем только сброс: он и объединяет блоки
+            start = chrono::high_resolution_clock::now();
+            check(lab2_fsync(fd) == 0, "test 12: lab2_fsync");
+            duration = chrono::high_resolution_clock::now() - start;
+            const double megabytes = static_cast<double>(file_size) / (1024 * 1024);
+            cout << "Max write " << max_write / 1024 << " KiB: " << megabytes / duration.count() << " MB/s\n";
+            // После lab2_fsync данные уже на диске, ещё до закрытия
+            check(read_from_disk(filename, 0, file_size) == vector<char>(file_size, 'x'), "test 12: file on disk after fsync");
+            lab2_close(fd);
+            free_all_cache_blocks();
+            reset_cache_stats();
+        }
+
+        const Lab2WritebackConfig defaults = {10, 30000, 1024 * 1024};
+        lab2_set_writeback(&defaults);
+        remove(filename);
+        lab2_cache_resize(180 * block_size);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test13) {
+        const char* big_filename = "fsync_big.bin";
+        const char* small_filename = "fsync_small.bin";
+        const int block_size = 4096;
+        const int big_blocks = 16384;
+        times = 10000;
+        vector<char> buf(block_size);
+
+        cout << "Test #13 - Frequent fsync of a small file next to a large cached file\n\n";
+
+        create_pattern_file(big_filename, static_cast<long long>(big_blocks) * block_size);
+        create_sparse_file(small_filename, 16 * block_size);
+        lab2_cache_resize(2 * big_blocks * block_size);
+        // Фоновая запись выключена: "грязные" блоки пишет только lab2_fsync
+        const Lab2WritebackConfig config = {100, 0, 1024 * 1024};
+        lab2_set_writeback(&config);
+
+        HANDLE big_fd = lab2_open(big_filename);
+        int mismatches = 0;
+        for (int i = 0; i < big_blocks; ++i) {
+            mismatches += lab2_read(big_fd, buf.data(), block_size) != block_size
+                          || !matches_pattern(buf.data(), static_cast<long long>(i) * block_size, block_size);
+        }
+        check(mismatches == 0, "test 13: data of the large file");
+        fd = lab2_open(small_filename);
+
+        // Каждая запись - свой байт-заполнитель, последняя запись блока видна на диске
+        vector<char> expected(16 * block_size, 0);
+        start = chrono::high_resolution_clock::now();
+        for (int i = 0; i < times; ++i) {
+            memset(buf.data(), 'A' + i % 26, block_size);
+            lab2_lseek(fd, (i % 16) * block_size, 0);
+            lab2_write(fd, buf.data(), block_size);
+            lab2_fsync(fd);
+        }
+        duration = chrono::high_resolution_clock::now() - start;
+        cout << "Cached blocks: " << big_blocks << ", " << duration.count() * 1e6 / times << " us per write + fsync\n";
+        for (int i = times - 16; i < times; ++i) {
+            memset(expected.data() + (i % 16) * block_size, 'A' + i % 26, block_size);
+        }
+        check(read_from_disk(small_filename, 0, expected.size()) == expected, "test 13: small file on disk after fsync");
+
+        lab2_close(fd);
+        lab2_close(big_fd);
+
+        free_all_cache_blocks();
+        reset_cache_stats();
+        const Lab2WritebackConfig defaults = {10, 30000, 1024 * 1024};
+        lab2_set_writeback(&defaults);
+        remove(big_filename);
+        remove(small_filename);
+        lab2_cache_resize(180 * block_size);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test14) {
+        const char* filename = "bulk_load_test.bin";
+        const int block_size = 4096;
+        const int file_blocks = 8192;
+        const int file_size = file_blocks * block_size;
+        const int chunk_size = 64 * 1024;
+        vector<char> buf(chunk_size);
+        const vector<char> fill(chunk_size, 'z');
+
+        cout << "Test #14 - Bulk load of a file by full-block writes\n\n";
+
+        lab2_cache_resize(2 * file_size);
+        const double megabytes = static_cast<double>(file_size) / (1024 * 1024);
+        // 0 - перезапись существующего файла, 1 - то же с чтением каждого блока перед записью
+        // (как при read-modify-write), 2 - дозапись в пустой файл
+        for (int mode = 0; mode <= 2; ++mode) {
+            create_pattern_file(filename, mode == 2 ? 0 : file_size);
+            int mismatches = 0;
+            fd = lab2_open(filename);
+            start = chrono::high_resolution_clock::now();
+            for (int written = 0; written < file_size; written += chunk_size) {
+                if (mode == 1) {
+                    mismatches += lab2_read(fd, buf.data(), chunk_size) != chunk_size
+                                  || !matches_pattern(buf.data(), written, chunk_size);
+                    lab2_lseek(fd, written, 0);
+                }
+                lab2_write(fd, fill.data(), chunk_size);
+            }
+            lab2_fsync(fd);
+            duration = chrono::high_resolution_clock::now() - start;
+            cout << (mode == 0 ? "Overwrite: " : mode == 1 ? "Read before overwrite: " : "Append to empty file: ")
+                 << megabytes / duration.count() << " MB/s"
+                 << " (hits: " << get_cache_hit() << ", misses: " << get_cache_miss() << ")\n";
+            lab2_close(fd);
+            check(mismatches == 0, "test 14: data read before the overwrite");
+            vector<char> on_disk = read_from_disk(filename, 0, file_size + 1);
+            check(on_disk.size() == static_cast<size_t>(file_size)
+                  && all_of(on_disk.begin(), on_disk.end(), [](char c) { return c == 'z'; }),
+                  "test 14: file on disk after the bulk load");
+            free_all_cache_blocks();
+            reset_cache_stats();
+        }
+
+        remove(filename);
+        lab2_cache_resize(180 * block_size);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test15) {
+        const char* hot_filename = "hot_set.bin";
+        const char* scan_filename = "scan.bin";
+        const int block_size = 4096;
+        const int cache_blocks = 1024;
+        const int hot_blocks = 768;
+        const int scan_blocks = 32768;
+        const int rounds = 16;
+        const int hot_reads = 8192;
+        vector<char> buf(block_size);
+
+        cout << "Test #15 - Hot random working set mixed with a cold sequential scan\n\n";
+
+        create_pattern_file(hot_filename, static_cast<long long>(hot_blocks) * block_size);
+        create_pattern_file(scan_filename, static_cast<long long>(scan_blocks) * block_size);
+        const pair<Lab2ReplacementPolicy, const char*> policies[] = {
+            {LAB2_REPLACE_LRU, "LRU"}, {LAB2_REPLACE_2Q, "2Q"}, {LAB2_REPLACE_ARC, "ARC"}};
+        for (const auto& [policy, name] : policies) {
+            const Lab2CacheConfig config = {static_cast<size_t>(cache_blocks) * block_size, block_size, policy, false, false};
+            lab2_cache_init(&config);
+            HANDLE hot_fd = lab2_open(hot_filename);
+            fd = lab2_open(scan_filename);
+
+            // Раунд: случайные чтения горячего набора, затем очередной кусок сканирования,
+            // который длиннее всего кэша
+            int hot_hits = 0;
+            int hot_misses = 0;
+            int mismatches = 0;
+            for (int round = 0; round < rounds; ++round) {
+                const int hits_before = get_cache_hit();
+                const int misses_before = get_cache_miss();
+                for (int i = 0; i < hot_reads; ++i) {
+                    const long long offset = static_cast<long long>(get_rand_from_to(0, hot_blocks - 1)) * block_size;
+                    lab2_lseek(hot_fd, offset, 0);
+                    mismatches += lab2_read(hot_fd, buf.data(), 64) != 64 || !matches_pattern(buf.data(), offset, 64);
+                }
+                hot_hits += get_cache_hit() - hits_before;
+                hot_misses += get_cache_miss() - misses_before;
+
+                const long long scan_offset = static_cast<long long>(round) * (scan_blocks / rounds) * block_size;
+                lab2_lseek(fd, scan_offset, 0);
+                for (int i = 0; i < scan_blocks / rounds; ++i) {
+                    mismatches += lab2_read(fd, buf.data(), block_size) != block_size
+                                  || !matches_pattern(buf.data(), scan_offset + static_cast<long long>(i) * block_size,
+                                                      block_size);
+                }
+            }
+            cout << name << ": hot set hit ratio " << 100.0 * hot_hits / (hot_hits + hot_misses) << "%"
+                 << ", overall hit ratio " << 100.0 * get_cache_hit() / (get_cache_hit() + get_cache_miss()) << "%\n";
+            check(mismatches == 0, "test 15: data of the hot set and the scan");
+
+            lab2_close(fd);
+            lab2_close(hot_fd);
+            free_all_cache_blocks();
+            reset_cache_stats();
+        }
+
+        const Lab2CacheConfig defaults = {180 * block_size, block_size, LAB2_REPLACE_LRU, false, false};
+        lab2_cache_init(&defaults);
+        remove(hot_filename);
+        remove(scan_filename);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test16) {
+        const char* filename = "clock_test.bin";
+        const int block_size = 4096;
+        const int cache_blocks = 4096;
+        const int evictions = 20000;
+        const int file_size = (cache_blocks + evictions) * block_size;
+        times = 1000000;
+        char buf[64];
+        memset(buf, 'c', 64);
+
+        cout << "Test #16 - Write hits and evicting misses with LRU and CLOCK\n\n";
+
+        // Фоновая запись выключена, чтобы не мешать замерам
+        const Lab2WritebackConfig config = {100, 0, 1024 * 1024};
+        lab2_set_writeback(&config);
+        const pair<Lab2ReplacementPolicy, const char*> policies[] = {
+            {LAB2_REPLACE_LRU, "LRU"}, {LAB2_REPLACE_CLOCK, "CLOCK"}};
+        for (const auto& [policy, name] : policies) {
+            create_pattern_file(filename, file_size);
+            const Lab2CacheConfig cache_config = {static_cast<size_t>(cache_blocks) * block_size, block_size, policy, false, false};
+            lab2_cache_init(&cache_config);
+            fd = lab2_open(filename);
+            lab2_fadvise(fd, 0, 0, LAB2_ADV_RANDOM);
+            for (int i = 0; i < cache_blocks; ++i) {
+                lab2_lseek(fd, static_cast<int64_t>(i) * block_size, 0);
+                lab2_read(fd, buf, 1);
+            }
+
+            // Попадание записи идёт под замком шарда: LRU переставляет блок в списке, CLOCK ставит признак
+            vector<int> offsets(4096);
+            for (int& offset : offsets) {
+                offset = get_rand_from_to(0, cache_blocks - 1) * block_size + get_rand_from_to(0, block_size - 64);
+            }
+            memset(buf, 'c', 64);
+            start = chrono::high_resolution_clock::now();
+            for (int i = 0; i < times; ++i) {
+                lab2_lseek(fd, offsets[i % offsets.size()], 0);
+                lab2_write(fd, buf, 64);
+            }
+            duration = chrono::high_resolution_clock::now() - start;
+            cout << name << ": " << duration.count() * 1e9 / times << " ns per write hit, ";
+            lab2_fsync(fd);
+
+            int mismatches = 0;
+            start = chrono::high_resolution_clock::now();
+            for (int i = cache_blocks; i < cache_blocks + evictions; ++i) {
+                lab2_lseek(fd, static_cast<int64_t>(i) * block_size, 0);
+                mismatches += lab2_read(fd, buf, 1) != 1 || !matches_pattern(buf, static_cast<long long>(i) * block_size, 1);
+            }
+            duration = chrono::high_resolution_clock::now() - start;
+            cout << duration.count() * 1e9 / evictions << " ns per evicting miss\n";
+            lab2_close(fd);
+
+            // На диске - узор с записанными кусками
+            vector<char> expected(static_cast<size_t>(cache_blocks) * block_size);
+            for (size_t i = 0; i < expected.size(); ++i) {
+                expected[i] = pattern_byte(static_cast<long long>(i));
+            }
+            for (const int offset : offsets) {
+                memset(expected.data() + offset, 'c', 64);
+            }
+            check(mismatches == 0, "test 16: data of evicting misses");
+            check(read_from_disk(filename, 0, expected.size()) == expected, "test 16: written hits on disk");
+            free_all_cache_blocks();
+            reset_cache_stats();
+        }
+
+        const Lab2WritebackConfig defaults = {10, 30000, 1024 * 1024};
+        lab2_set_writeback(&defaults);
+        const Lab2CacheConfig cache_defaults = {180 * block_size, block_size, LAB2_REPLACE_LRU, false, false};
+        lab2_cache_init(&cache_defaults);
+        remove(filename);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test17) {
+        const char* filename = "admission_test.bin";
+        const int block_size = 4096;
+        const int cache_blocks = 1024;
+        const int hot_blocks = 768;
+        const int file_blocks = 65536;
+        times = 200000;
+        vector<char> buf(block_size);
+
+        cout << "Test #17 - Hot working set mixed with one-off random probes, with and without the admission filter\n\n";
+
+        create_pattern_file(filename, static_cast<long long>(file_blocks) * block_size);
+        for (int filter = 0; filter <= 1; ++filter) {
+            const Lab2CacheConfig config = {static_cast<size_t>(cache_blocks) * block_size, block_size, LAB2_REPLACE_LRU, filter != 0, false};
+            lab2_cache_init(&config);
+            fd = lab2_open(filename);
+            lab2_fadvise(fd, 0, 0, LAB2_ADV_RANDOM);
+
+            // Каждое второе чтение - горячий блок из начала файла, остальные - случайные блоки по всему файлу.
+            // Блоки, не пущенные фильтром, читаются мимо кэша, но данные должны быть те же
+            int hot_hits = 0;
+            int hot_reads = 0;
+            int mismatches = 0;
+            start = chrono::high_resolution_clock::now();
+            for (int i = 0; i < times; ++i) {
+                const bool hot = i % 2 == 0;
+                const int block = hot ? get_rand_from_to(0, hot_blocks - 1) : get_rand_from_to(hot_blocks, file_blocks - 1);
+                const int hits_before = get_cache_hit();
+                lab2_lseek(fd, static_cast<int64_t>(block) * block_size, 0);
+                mismatches += lab2_read(fd, buf.data(), block_size) != block_size
+                              || !matches_pattern(buf.data(), static_cast<long long>(block) * block_size, block_size);
+                if (hot) {
+                    hot_hits += get_cache_hit() - hits_before;
+                    hot_reads++;
+                }
+            }
+            duration = chrono::high_resolution_clock::now() - start;
+            cout << (filter ? "TinyLFU admission: " : "Admit every miss: ") << duration.count() << " seconds"
+                 << ", hot set hit ratio " << 100.0 * hot_hits / hot_reads << "%"
+                 << " (hits: " << get_cache_hit() << ", misses: " << get_cache_miss()
+                 << ", rejected: " << get_admission_rejects() << ")\n";
+            check(mismatches == 0, filter ? "test 17: data with the admission filter" : "test 17: data without the filter");
+
+            lab2_close(fd);
+            free_all_cache_blocks();
+            reset_cache_stats();
+        }
+
+        const Lab2CacheConfig defaults = {180 * block_size, block_size, LAB2_REPLACE_LRU, false, false};
+        lab2_cache_init(&defaults);
+        remove(filename);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test18) {
+        const char* filename = "pinned_test.bin";
+        const int block_size = 64 * 1024;
+        const int file_size = 16 * 1024 * 1024;
+        const int chunk = 1024 * 1024;
+        times = 2000;
+        vector<char> buf(chunk);
+
+        cout << "Test #18 - Reading cached 1 MiB chunks: copy (lab2_read) vs pinned views (lab2_read_pinned)\n\n";
+
+        create_sparse_file(filename, file_size);
+        const Lab2CacheConfig config = {2 * static_cast<size_t>(file_size), block_size, LAB2_REPLACE_LRU, false, false};
+        lab2_cache_init(&config);
+        fd = lab2_open(filename);
+        // Прогрев: файл заполняется случайными байтами и весь остаётся в кэше
+        vector<char> expected(file_size);
+        for (int offset = 0; offset < file_size; offset += chunk) {
+            for (int k = 0; k < chunk; ++k) {
+                buf[k] = static_cast<char>(get_rand_from_to(0, 255));
+            }
+            memcpy(expected.data() + offset, buf.data(), chunk);
+            lab2_write(fd, buf.data(), chunk);
+        }
+        lab2_fsync(fd);
+        reset_cache_stats();
+
+        // Оба способа суммируют прочитанные байты, чтобы данные действительно были прочитаны.
+        // Проходы читают одни и те же куски, поэтому суммы должны совпасть с суммой записанного
+        unsigned long long expected_checksum = 0;
+        for (int i = 0; i < times; ++i) {
+            const int offset = (i % (file_size / chunk)) * chunk;
+            for (int k = 0; k < chunk; k += 64) {
+                expected_checksum += static_cast<unsigned char>(expected[offset + k]);
+            }
+        }
+
+        unsigned long long checksum = 0;
+        start = chrono::high_resolution_clock::now();
+        for (int i = 0; i < times; ++i) {
+            lab2_lseek(fd, (i % (file_size / chunk)) * chunk, 0);
+            lab2_read(fd, buf.data(), chunk);
+            for (int k = 0; k < chunk; k += 64) {
+                checksum += static_cast<unsigned char>(buf[k]);
+            }
+        }
+        duration = chrono::high_resolution_clock::now() - start;
+        cout << "lab2_read: " << duration.count() * 1e6 / times << " us per MiB (checksum " << checksum << ")\n";
+        check(checksum == expected_checksum, "test 18: checksum of lab2_read");
+
+        checksum = 0;
+        size_t viewed = 0;
+        start = chrono::high_resolution_clock::now();
+        for (int i = 0; i < times; ++i) {
+            Lab2PinnedView view;
+            lab2_read_pinned(fd, static_cast<int64_t>(i % (file_size / chunk)) * chunk, chunk, &view);
+            viewed += view.size;
+            for (size_t span = 0; span < view.span_count; ++span) {
+                for (size_t k = 0; k < view.spans[span].size; k += 64) {
+                    checksum += static_cast<unsigned char>(view.spans[span].data[k]);
+                }
+            }
+            lab2_release_pinned(&view);
+        }
+        duration = chrono::high_resolution_clock::now() - start;
+        cout << "lab2_read_pinned: " << duration.count() * 1e6 / times << " us per MiB (checksum " << checksum << ")"
+             << ", hits: " << get_cache_hit() << ", misses: " << get_cache_miss() << "\n";
+        check(checksum == expected_checksum && viewed == static_cast<size_t>(times) * chunk,
+              "test 18: checksum of lab2_read_pinned");
+
+        // Полная сверка одного представления, собранного из нескольких блоков
+        Lab2PinnedView view;
+        check(lab2_read_pinned(fd, chunk - 100, 3 * block_size, &view) == 0, "test 18: lab2_read_pinned");
+        vector<char> gathered;
+        for (size_t span = 0; span < view.span_count; ++span) {
+            gathered.insert(gathered.end(), view.spans[span].data, view.spans[span].data + view.spans[span].size);
+        }
+        lab2_release_pinned(&view);
+        check(gathered == vector<char>(expected.begin() + chunk - 100, expected.begin() + chunk - 100 + 3 * block_size),
+              "test 18: data of a pinned view");
+
+        lab2_close(fd);
+        check(read_from_disk(filename, 0, file_size) == expected, "test 18: file on disk");
+
+        free_all_cache_blocks();
+        reset_cache_stats();
+        const Lab2CacheConfig defaults = {180 * 4096, 4096, LAB2_REPLACE_LRU, false, false};
+        lab2_cache_init(&defaults);
+        remove(filename);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test19) {
+        const char* hot_name = "bypass_hot.bin";
+        const char* scan_name = "bypass_scan.bin";
+        const int block_size = 4096;
+        const int hot_blocks = 64;
+        const int scan_size = 64 * 1024 * 1024;
+        const int chunk = 1024 * 1024;
+        // Буфер выровнен: чтение мимо кэша идёт в него напрямую
+        char *buf = static_cast<char*>(::operator new(chunk, std::align_val_t(4096)));
+
+        cout << "Test #19 - One-off scan of a 64 MiB file in 1 MiB reads next to a hot set, with and without the bypass\n\n";
+
+        create_pattern_file(hot_name, hot_blocks * block_size);
+        create_pattern_file(scan_name, scan_size);
+        for (int bypass = 0; bypass <= 1; ++bypass) {
+            set_read_bypass(bypass ? 256 * 1024 : 0);
+            const HANDLE hot = lab2_open(hot_name);
+            lab2_fadvise(hot, 0, 0, LAB2_ADV_RANDOM);
+            for (int i = 0; i < hot_blocks; ++i) {
+                lab2_read(hot, buf, block_size);
+            }
+
+            int mismatches = 0;
+            fd = lab2_open(scan_name);
+            start = chrono::high_resolution_clock::now();
+            for (int offset = 0; offset < scan_size; offset += chunk) {
+                mismatches += lab2_read(fd, buf, chunk) != chunk || !matches_pattern(buf, offset, chunk);
+            }
+            duration = chrono::high_resolution_clock::now() - start;
+            lab2_close(fd);
+
+            // Горячие блоки, пережившие сканирование
+            const int hits_before = get_cache_hit();
+            lab2_lseek(hot, 0, 0);
+            for (int i = 0; i < hot_blocks; ++i) {
+                mismatches += lab2_read(hot, buf, block_size) != block_size
+                              || !matches_pattern(buf, static_cast<long long>(i) * block_size, block_size);
+            }
+            cout << (bypass ? "Bypass above 256 KiB: " : "Through the cache: ") << duration.count() << " seconds"
+                 << ", " << scan_size / duration.count() / (1024 * 1024) << " MiB/s"
+                 << ", hot set hit ratio after the scan " << 100.0 * (get_cache_hit() - hits_before) / hot_blocks << "%"
+                 << " (bypassed bytes: " << get_bypassed_bytes() << ")\n";
+            check(mismatches == 0, bypass ? "test 19: data read around the cache" : "test 19: data read through the cache");
+            if (bypass) {
+                check(get_bypassed_bytes() > 0, "test 19: large reads bypass the cache");
+            }
+
+            lab2_close(hot);
+            free_all_cache_blocks();
+            reset_cache_stats();
+        }
+
+        ::operator delete(buf, std::align_val_t(4096));
+
+        set_read_bypass(0);
+        remove(hot_name);
+        remove(scan_name);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test20) {
+        const char* filename = "map_test.bin";
+#ifdef _WIN32
+        // Блок показывается в окне отдельным отображением, а их выравнивание на Windows - 64 КиБ
+        const int block_size = 64 * 1024;
+#else
+        const int block_size = 4096;
+#endif
+        const int file_size = 8 * 1024 * 1024;
+        times = 1000000;
+        char buf[8];
+
+        cout << "Test #20 - Random 8-byte lookups in an 8 MiB file: lab2_lseek + lab2_read vs a lab2_map window\n\n";
+
+        create_pattern_file(filename, file_size);
+        const Lab2CacheConfig config = {2 * static_cast<size_t>(file_size), block_size, LAB2_REPLACE_LRU, false, true};
+        lab2_cache_init(&config);
+        fd = lab2_open(filename);
+
+        vector<int> offsets(times);
+        unsigned long long expected_checksum = 0;
+        for (int& offset : offsets) {
+            offset = get_rand_from_to(0, file_size / 8 - 1) * 8;
+            expected_checksum += static_cast<unsigned char>(pattern_byte(offset));
+        }
+        // Окно загружает весь файл в кэш, поэтому сначала создаём его
+        char* window = static_cast<char*>(lab2_map(fd, 0, file_size, LAB2_MAP_WRITE));
+        check(window != nullptr, "test 20: lab2_map");
+        check(window != nullptr && matches_pattern(window, 0, file_size), "test 20: data of the mapping");
+        reset_cache_stats();
+
+        unsigned long long checksum = 0;
+        start = chrono::high_resolution_clock::now();
+        for (int i = 0; i < times; ++i) {
+            lab2_lseek(fd, offsets[i], 0);
+            lab2_read(fd, buf, sizeof(buf));
+            checksum += static_cast<unsigned char>(buf[0]);
+        }
+        duration = chrono::high_resolution_clock::now() - start;
+        cout << "lab2_read: " << duration.count() * 1e9 / times << " ns per lookup (checksum " << checksum << ")\n";
+        check(checksum == expected_checksum, "test 20: checksum of lab2_read");
+
+        if (window != nullptr) {
+            checksum = 0;
+            start = chrono::high_resolution_clock::now();
+            for (int i = 0; i < times; ++i) {
+                memcpy(buf, window + offsets[i], sizeof(buf));
+                checksum += static_cast<unsigned char>(buf[0]);
+            }
+            duration = chrono::high_resolution_clock::now() - start;
+            cout << "lab2_map: " << duration.count() * 1e9 / times << " ns per lookup (checksum " << checksum << ")\n";
+            check(checksum == expected_checksum, "test 20: checksum of the mapping");
+
+            // Запись через окно попадает в файл после lab2_msync
+            window[12345] = 42;
+            check(lab2_msync(window) == 0, "test 20: lab2_msync");
+            check(lab2_unmap(window) == 0, "test 20: lab2_unmap");
+            lab2_lseek(fd, 12345, 0);
+            check(lab2_read(fd, buf, 1) == 1 && buf[0] == 42, "test 20: byte written through the mapping reads back");
+        }
+
+        lab2_close(fd);
+        if (window != nullptr) {
+            check(read_from_disk(filename, 12345, 1) == vector<char>(1, 42), "test 20: byte written through the mapping on disk");
+        }
+
+        free_all_cache_blocks();
+        reset_cache_stats();
+        const Lab2CacheConfig defaults = {180 * 4096, 4096, LAB2_REPLACE_LRU, false, false};
+        lab2_cache_init(&defaults);
+        remove(filename);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test21) {
+        const char* filename = "pread_test.bin";
+        const int block_size = 4096;
+        const int file_size = 4 * 1024 * 1024;
+        const int threads = 4;
+        const int reads_per_thread = 200000;
+        const int records = 16;
+        const int record_size = 64;
+        times = 100000;
+
+        cout << "Test #21 - Shared descriptor: lab2_lseek + lab2_read under a lock vs lab2_pread, "
+                "and a lab2_preadv of " << records << " records vs " << records << " reads\n\n";
+
+        create_pattern_file(filename, file_size);
+        const Lab2CacheConfig config = {2 * static_cast<size_t>(file_size), block_size, LAB2_REPLACE_LRU, false, false};
+        lab2_cache_init(&config);
+        fd = lab2_open(filename);
+        vector<char> warm(file_size);
+        check(lab2_read(fd, warm.data(), file_size) == file_size && matches_pattern(warm.data(), 0, file_size),
+              "test 21: data of the warm-up read");
+
+        // Без позиционного чтения общий дескриптор приходится защищать своей блокировкой:
+        // иначе чужой lab2_lseek сдвигает смещение между нашими lab2_lseek и lab2_read
+        atomic<int> mismatches {0};
+        for (int variant = 0; variant < 2; ++variant) {
+            mutex seek_lock;
+            vector<thread> workers;
+            start = chrono::high_resolution_clock::now();
+            for (int t = 0; t < threads; ++t) {
+                workers.emplace_back([&, t] {
+                    mt19937 rng(t);
+                    char thread_buf[record_size];
+                    for (int i = 0; i < reads_per_thread; ++i) {
+                        const int offset = static_cast<int>(rng() % (file_size - record_size));
+                        ptrdiff_t bytes;
+                        if (variant == 0) {
+                            lock_guard<mutex> guard(seek_lock);
+                            lab2_lseek(fd, offset, 0);
+                            bytes = lab2_read(fd, thread_buf, record_size);
+                        } else {
+                            bytes = lab2_pread(fd, thread_buf, record_size, offset);
+                        }
+                        // Чужое смещение выдал бы уже первый байт
+                        if (bytes != record_size || thread_buf[0] != pattern_byte(offset)) {
+                            mismatches++;
+                        }
+                    }
+                });
+            }
+            for (thread& worker : workers) {
+                worker.join();
+            }
+            duration = chrono::high_resolution_clock::now() - start;
+            cout << (variant == 0 ? "lab2_lseek + lab2_read: " : "lab2_pread: ")
+                 << duration.count() * 1e9 / (threads * reads_per_thread) << " ns per read\n";
+        }
+        check(mismatches == 0, "test 21: data read through the shared descriptor");
+
+        // Подряд идущие записи раскладываются по отдельным буферам одним вызовом
+        vector<char> record_bufs(records * record_size);
+        Lab2IoVec segments[records];
+        for (int r = 0; r < records; ++r) {
+            segments[r] = {record_bufs.data() + r * record_size, record_size};
+        }
+        vector<int> offsets(times);
+        for (int& offset : offsets) {
+            offset = get_rand_from_to(0, file_size / (records * record_size) - 1) * records * record_size;
+        }
+
+        start = chrono::high_resolution_clock::now();
+        for (int i = 0; i < times; ++i) {
+            for (int r = 0; r < records; ++r) {
+                lab2_pread(fd, segments[r].base, record_size, offsets[i] + r * record_size);
+            }
+        }
+        duration = chrono::high_resolution_clock::now() - start;
+        cout << records << " x lab2_pread: " << duration.count() * 1e9 / times << " ns per group\n";
+        check(matches_pattern(record_bufs.data(), offsets[times - 1], record_bufs.size()), "test 21: data of lab2_pread");
+
+        record_bufs.assign(record_bufs.size(), 0);
+        start = chrono::high_resolution_clock::now();
+        for (int i = 0; i < times; ++i) {
+            lab2_preadv(fd, segments, records, offsets[i]);
+        }
+        duration = chrono::high_resolution_clock::now() - start;
+        cout << "lab2_preadv: " << duration.count() * 1e9 / times << " ns per group\n";
+        check(matches_pattern(record_bufs.data(), offsets[times - 1], record_bufs.size()), "test 21: data of lab2_preadv");
+
+        // Сборная запись: сегменты разной длины ложатся подряд через границы блоков
+        char head[100], middle[5000], tail[300];
+        memset(head, 'h', sizeof(head));
+        memset(middle, 'm', sizeof(middle));
+        memset(tail, 't', sizeof(tail));
+        const Lab2IoVec gather[] = {{head, sizeof(head)}, {middle, sizeof(middle)}, {tail, sizeof(tail)}};
+        const int64_t gather_offset = block_size - 50;
+        const size_t gather_size = sizeof(head) + sizeof(middle) + sizeof(tail);
+        check(lab2_pwritev(fd, gather, 3, gather_offset) == static_cast<ptrdiff_t>(gather_size), "test 21: lab2_pwritev result");
+        lab2_fsync(fd);
+        vector<char> expected(gather_size + 2);
+        expected.front() = pattern_byte(gather_offset - 1);
+        memcpy(expected.data() + 1, head, sizeof(head));
+        memcpy(expected.data() + 1 + sizeof(head), middle, sizeof(middle));
+        memcpy(expected.data() + 1 + sizeof(head) + sizeof(middle), tail, sizeof(tail));
+        expected.back() = pattern_byte(gather_offset + gather_size);
+        check(read_from_disk(filename, gather_offset - 1, expected.size()) == expected, "test 21: data of lab2_pwritev on disk");
+
+        lab2_close(fd);
+
+        free_all_cache_blocks();
+        reset_cache_stats();
+        const Lab2CacheConfig defaults = {180 * block_size, block_size, LAB2_REPLACE_LRU, false, false};
+        lab2_cache_init(&defaults);
+        remove(filename);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test22) {
+        const char* filename = "large_test.bin";
+        const int block_size = 4096;
+        const long long gib = 1024LL * 1024 * 1024;
+        const long long file_size = 6 * gib;
+        const int chunk = 1024 * 1024;
+        const int chunks = 64;
+
+        cout << "Test #22 - Reads and writes across the 4 GiB boundary of a sparse 6 GiB file\n\n";
+
+        // 6 ГБ узора писать долго: файл разреженный, за пределами записанного - нули
+        create_sparse_file(filename, file_size);
+        const Lab2CacheConfig config = {16 * static_cast<size_t>(chunk), block_size, LAB2_REPLACE_LRU, false, false};
+        lab2_cache_init(&config);
+
+        // Данные пишем так, чтобы запись пересекала границу 4 ГБ, и ещё одну - через SEEK_END
+        vector<char> pattern(chunk);
+        for (int i = 0; i < chunk; ++i) {
+            pattern[i] = static_cast<char>(i * 7 + 1);
+        }
+        const long long straddle = 4 * gib - chunk / 2;
+        fd = lab2_open(filename);
+        lab2_lseek(fd, straddle, SEEK_SET);
+        lab2_write(fd, pattern.data(), chunk);
+        const long long after_write = lab2_lseek(fd, 0, SEEK_CUR);
+        const long long tail = lab2_lseek(fd, -chunk, SEEK_END);
+        lab2_write(fd, pattern.data(), chunk);
+        lab2_close(fd);
+
+        // Сверяем с файлом, прочитанным в обход кэша: данные должны лечь точно по своим смещениям
+        cout << "Offset after the write: " << after_write << " (expected " << straddle + chunk << ")\n";
+        cout << "SEEK_END - 1 MiB: " << tail << " (expected " << file_size - chunk << ")\n";
+        check(after_write == straddle + chunk, "test 22: offset after the write across 4 GiB");
+        check(tail == file_size - chunk, "test 22: SEEK_END");
+        check(read_from_disk(filename, straddle, chunk) == pattern, "test 22: data at 4 GiB - 512 KiB on disk");
+        check(read_from_disk(filename, tail, chunk) == pattern, "test 22: data at the end of the file on disk");
+
+        // Последовательное чтение 64 МБ за границей 4 ГБ через кэш: сначала записанное, дальше нули
+        vector<char> buf(chunk);
+        const vector<char> zeros(chunk, 0);
+        fd = lab2_open(filename);
+        lab2_lseek(fd, straddle, SEEK_SET);
+        bool read_ok = true;
+        start = chrono::high_resolution_clock::now();
+        for (int i = 0; i < chunks; ++i) {
+            if (lab2_read(fd, buf.data(), chunk) != chunk || buf != (i == 0 ? pattern : zeros)) {
+                read_ok = false;
+            }
+        }
+        duration = chrono::high_resolution_clock::now() - start;
+        cout << "Read " << chunks << " MiB from 4 GiB - 512 KiB: " << chunks / duration.count() << " MiB/s\n";
+        check(read_ok, "test 22: data read across 4 GiB");
+
+        lab2_close(fd);
+
+        free_all_cache_blocks();
+        reset_cache_stats();
+        const Lab2CacheConfig defaults = {180 * block_size, block_size, LAB2_REPLACE_LRU, false, false};
+        lab2_cache_init(&defaults);
+        remove(filename);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test23) {
+        const char* filename = "shared_test.bin";
+        const int block_size = 4096;
+        const int file_size = 4 * 1024 * 1024;
+        const int piece = 64 * 1024;
+        times = 2000;
+
+        cout << "Test #23 - Two descriptors on one file, and open-read-close cycles of a cached file\n\n";
+
+        create_pattern_file(filename, file_size);
+        const Lab2CacheConfig config = {2 * static_cast<size_t>(file_size), block_size, LAB2_REPLACE_LRU, false, false};
+        lab2_cache_init(&config);
+        // Файл только что создан: до закрытия его время изменения должно устояться
+        this_thread::sleep_for(chrono::milliseconds(200));
+
+        // Второе открытие того же файла находит блоки первого
+        vector<char> buf(file_size);
+        HANDLE first = lab2_open(filename);
+        HANDLE second = lab2_open(filename);
+        reset_cache_stats();
+        check(lab2_read(first, buf.data(), file_size) == file_size && matches_pattern(buf.data(), 0, file_size),
+              "test 23: data read through the first descriptor");
+        cout << "First descriptor: " << get_cache_miss() << " misses\n";
+        reset_cache_stats();
+        buf.assign(file_size, 0);
+        check(lab2_read(second, buf.data(), file_size) == file_size && matches_pattern(buf.data(), 0, file_size),
+              "test 23: data read through the second descriptor");
+        cout << "Second descriptor: " << get_cache_miss() << " misses\n";
+        check(get_cache_miss() == 0, "test 23: second descriptor shares the blocks of the first");
+        lab2_close(first);
+        lab2_close(second);
+
+        // Блоки переживают закрытие: каждый цикл открытия читает из кэша
+        reset_cache_stats();
+        int mismatches = 0;
+        start = chrono::high_resolution_clock::now();
+        for (int i = 0; i < times; ++i) {
+            const int64_t offset = static_cast<int64_t>(get_rand_from_to(0, file_size / piece - 1)) * piece;
+            fd = lab2_open(filename);
+            lab2_lseek(fd, offset, SEEK_SET);
+            mismatches += lab2_read(fd, buf.data(), piece) != piece || !matches_pattern(buf.data(), offset, piece);
+            lab2_close(fd);
+        }
+        duration = chrono::high_resolution_clock::now() - start;
+        cout << "Open + read 64 KiB + close: " << duration.count() * 1e6 / times << " us per cycle, "
+             << get_cache_hit() << " hits, " << get_cache_miss() << " misses\n";
+        check(mismatches == 0, "test 23: data of open-read-close cycles");
+        check(get_cache_miss() == 0, "test 23: blocks survive close");
+
+        free_all_cache_blocks();
+        reset_cache_stats();
+        const Lab2CacheConfig defaults = {180 * block_size, block_size, LAB2_REPLACE_LRU, false, false};
+        lab2_cache_init(&defaults);
+        remove(filename);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test24) {
+        const int block_size = 4096;
+        const int files = 16;
+        const int file_size = 16 * 1024;
+        times = 20000;
+        char buf[file_size];
+
+        cout << "Test #24 - Open + read + close of " << files << " small files: blocks dropped at close vs retained\n\n";
+
+        vector<string> names;
+        for (int i = 0; i < files; ++i) {
+            names.push_back("config_" + to_string(i) + ".bin");
+            create_pattern_file(names.back().c_str(), file_size);
+        }
+        const Lab2CacheConfig config = {1024 * static_cast<size_t>(block_size), block_size, LAB2_REPLACE_LRU, false, false};
+        lab2_cache_init(&config);
+        // Блоки только что изменённого файла не сохраняются: ждём, пока время изменения станет надёжным
+        this_thread::sleep_for(chrono::milliseconds(200));
+
+        for (const size_t retention : {size_t(0), size_t(256)}) {
+            set_closed_file_retention(retention);
+            reset_cache_stats();
+            int mismatches = 0;
+            start = chrono::high_resolution_clock::now();
+            for (int i = 0; i < times; ++i) {
+                fd = lab2_open(names[get_rand_from_to(0, files - 1)].c_str());
+                mismatches += lab2_read(fd, buf, file_size) != file_size || !matches_pattern(buf, 0, file_size);
+                lab2_close(fd);
+            }
+            duration = chrono::high_resolution_clock::now() - start;
+            cout << (retention == 0 ? "Dropped at close: " : "Retained: ") << duration.count() * 1e6 / times
+                 << " us per cycle, " << get_cache_hit() << " hits, " << get_cache_miss() << " misses\n";
+            check(mismatches == 0, "test 24: data of open-read-close cycles");
+            if (retention != 0) {
+                // Промахи - только первые открытия каждого файла
+                check(get_cache_miss() <= files * file_size / block_size, "test 24: retained blocks are reused");
+            }
+        }
+
+        // Файл переписан в обход кэша того же размера: повторное открытие видит новые данные по времени изменения
+        this_thread::sleep_for(chrono::milliseconds(20));
+        memset(buf, 7, sizeof(buf));
+        HANDLE raw_fd = raw_open(names[0].c_str(), true);
+        raw_write(raw_fd, buf, file_size);
+        raw_close(raw_fd);
+        // Буфер очищается: неудачное чтение не должно оставить в нём ожидаемое значение
+        memset(buf, 0, sizeof(buf));
+        fd = lab2_open(names[0].c_str());
+        const ptrdiff_t reread = lab2_read(fd, buf, file_size);
+        lab2_close(fd);
+        check(reread == file_size && all_of(buf, buf + file_size, [](char c) { return c == 7; }),
+              "test 24: outside rewrite is seen after reopening");
+
+        free_all_cache_blocks();
+        reset_cache_stats();
+        const Lab2CacheConfig defaults = {180 * block_size, block_size, LAB2_REPLACE_LRU, false, false};
+        lab2_cache_init(&defaults);
+        for (const string& name : names) {
+            remove(name.c_str());
+        }
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test25) {
+        const char* filename = "advice_test.bin";
+        const int block_size = 4096;
+        const int file_blocks = 4096;
+        const int written_blocks = 64;
+        vector<char> buf(block_size);
+
+        cout << "Test #25 - Sequential scan with SEQUENTIAL and RANDOM advice, and DONTNEED of written blocks\n\n";
+
+        create_pattern_file(filename, static_cast<long long>(file_blocks) * block_size);
+        lab2_cache_resize(1024 * block_size);
+        fd = lab2_open(filename);
+
+        const pair<Lab2Advice, const char*> advices[] = {{LAB2_ADV_SEQUENTIAL, "SEQUENTIAL"}, {LAB2_ADV_RANDOM, "RANDOM"}};
+        for (const auto& [advice, name] : advices) {
+            free_all_cache_blocks();
+            reset_cache_stats();
+            lab2_fadvise(fd, 0, 0, advice);
+            int mismatches = 0;
+            start = chrono::high_resolution_clock::now();
+            lab2_lseek(fd, 0, 0);
+            for (int i = 0; i < file_blocks; ++i) {
+                mismatches += lab2_read(fd, buf.data(), block_size) != block_size
+                              || !matches_pattern(buf.data(), static_cast<long long>(i) * block_size, block_size);
+            }
+            duration = chrono::high_resolution_clock::now() - start;
+            cout << name << ": " << duration.count() * 1e9 / file_blocks << " ns per block"
+                 << " (hits: " << get_cache_hit() << ", misses: " << get_cache_miss()
+                 << ", readahead hits: " << get_readahead_hit() << ", readahead waste: " << get_readahead_waste() << ")\n";
+            check(mismatches == 0, advice == LAB2_ADV_RANDOM ? "test 25: data with RANDOM" : "test 25: data with SEQUENTIAL");
+            if (advice == LAB2_ADV_RANDOM) {
+                // Упреждающее чтение выключено: каждый блок - промах, лишних загрузок нет
+                check(get_readahead_hit() == 0 && get_readahead_waste() == 0, "test 25: RANDOM turns readahead off");
+                check(get_cache_miss() == file_blocks, "test 25: RANDOM reads every block on demand");
+            } else {
+                check(get_readahead_hit() > 0, "test 25: SEQUENTIAL reads ahead");
+            }
+        }
+
+        // Фоновая запись выключена: записанное лежит только в кэше, пока DONTNEED не запишет его на диск
+        const Lab2WritebackConfig config = {100, 0, 1024 * 1024};
+        lab2_set_writeback(&config);
+        lab2_fadvise(fd, 0, 0, LAB2_ADV_NORMAL);
+        memset(buf.data(), 'd', block_size);
+        for (int i = 0; i < written_blocks; ++i) {
+            lab2_lseek(fd, static_cast<int64_t>(i) * block_size, 0);
+            lab2_write(fd, buf.data(), block_size);
+        }
+        lab2_fadvise(fd, 0, static_cast<int64_t>(written_blocks) * block_size, LAB2_ADV_DONTNEED);
+        check(read_from_disk(filename, 0, static_cast<size_t>(written_blocks) * block_size)
+                  == vector<char>(static_cast<size_t>(written_blocks) * block_size, 'd'),
+              "test 25: DONTNEED writes dirty blocks to disk");
+
+        // Сброшенные блоки читаются заново с диска
+        reset_cache_stats();
+        lab2_fadvise(fd, 0, 0, LAB2_ADV_RANDOM);
+        int mismatches = 0;
+        for (int i = 0; i < written_blocks; ++i) {
+            lab2_lseek(fd, static_cast<int64_t>(i) * block_size, 0);
+            mismatches += lab2_read(fd, buf.data(), block_size) != block_size || buf[0] != 'd' || buf[block_size - 1] != 'd';
+        }
+        check(mismatches == 0, "test 25: data after DONTNEED");
+        check(get_cache_miss() == written_blocks, "test 25: DONTNEED drops blocks from the cache");
+        lab2_close(fd);
+
+        free_all_cache_blocks();
+        reset_cache_stats();
+        const Lab2WritebackConfig defaults = {10, 30000, 1024 * 1024};
+        lab2_set_writeback(&defaults);
+        remove(filename);
+        lab2_cache_resize(180 * block_size);
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (test26) {
+        const char* names[] = {"quota_a.bin", "quota_b.bin"};
+        const int block_size = 4096;
+        const int cache_blocks = 256;
+        const int file_blocks = 1024;
+        vector<char> buf(block_size);
+
+        cout << "Test #26 - Two files read past the cache capacity: global eviction vs per-file quota, "
+                "and a cache full of pinned blocks\n\n";
+
+        for (const char* name : names) {
+            create_pattern_file(name, static_cast<long long>(file_blocks) * block_size);
+        }
+        const Lab2CacheConfig config = {cache_blocks * static_cast<size_t>(block_size), block_size, LAB2_REPLACE_LRU, false, false};
+        lab2_cache_init(&config);
+
+        // Второй файл открыт дважды: по квоте ему достаются две трети кэша, первому - треть
+        const pair<Lab2EvictionPolicy, const char*> policies[] = {{LAB2_EVICT_GLOBAL, "Global"},
+                                                                  {LAB2_EVICT_PER_FILE_QUOTA, "Per-file quota"}};
+        for (const auto& [policy, policy_name] : policies) {
+            set_eviction_policy(policy);
+            HANDLE fds[] = {lab2_open(names[0]), lab2_open(names[1])};
+            HANDLE second_open = lab2_open(names[1]);
+            const int quotas[] = {cache_blocks / 3, cache_blocks * 2 / 3};
+            for (HANDLE file : fds) {
+                lab2_fadvise(file, 0, 0, LAB2_ADV_RANDOM);
+            }
+            int mismatches = 0;
+            int max_cached = 0;
+            int max_file_cached[] = {0, 0};
+            start = chrono::high_resolution_clock::now();
+            for (int i = 0; i < file_blocks; ++i) {
+                for (int f = 0; f < 2; ++f) {
+                    const long long offset = static_cast<long long>(i) * block_size;
+                    mismatches += lab2_pread(fds[f], buf.data(), block_size, offset) != block_size
+                                  || !matches_pattern(buf.data(), offset, block_size);
+                    max_cached = max(max_cached, get_cached_blocks());
+                    max_file_cached[f] = max(max_file_cached[f], get_file_cached_blocks(fds[f]));
+                }
+            }
+            duration = chrono::high_resolution_clock::now() - start;
+            cout << policy_name << ": " << duration.count() * 1e9 / (2 * file_blocks) << " ns per block, at most "
+                 << max_cached << " blocks cached (" << max_file_cached[0] << " and " << max_file_cached[1] << " per file)\n";
+            check(mismatches == 0, "test 26: data of both files");
+            check(max_cached <= cache_blocks, "test 26: cached blocks stay within the capacity");
+            if (policy == LAB2_EVICT_PER_FILE_QUOTA) {
+                check(max_file_cached[0] <= quotas[0] && max_file_cached[1] <= quotas[1], "test 26: each file stays within its quota");
+            }
+            lab2_close(fds[0]);
+            lab2_close(fds[1]);
+            lab2_close(second_open);
+            free_all_cache_blocks();
+            reset_cache_stats();
+        }
+        set_eviction_policy(LAB2_EVICT_GLOBAL);
+
+        // Закреплённые блоки не вытесняются: когда ими занят весь шард, чтение и запись его блока не проходят
+        const Lab2CacheConfig small = {64 * static_cast<size_t>(block_size), block_size, LAB2_REPLACE_LRU, false, false};
+        lab2_cache_init(&small);
+        fd = lab2_open(names[0]);
+        lab2_fadvise(fd, 0, 0, LAB2_ADV_RANDOM);
+        vector<Lab2PinnedView> views(file_blocks);
+        int pinned = 0;
+        while (pinned < file_blocks
+               && lab2_read_pinned(fd, static_cast<int64_t>(pinned) * block_size, block_size, &views[pinned]) == 0) {
+            pinned++;
+        }
+        check(pinned < file_blocks && get_cached_blocks() <= 64, "test 26: pinned blocks fill the cache");
+        const int64_t blocked_offset = static_cast<int64_t>(pinned) * block_size;
+        check(lab2_pread(fd, buf.data(), block_size, blocked_offset) == -1, "test 26: read fails when nothing can be evicted");
+        check(lab2_pwrite(fd, buf.data(), block_size, blocked_offset) == -1, "test 26: write fails when nothing can be evicted");
+        for (int i = 0; i < pinned; ++i) {
+            lab2_release_pinned(&views[i]);
+        }
+        check(lab2_pread(fd, buf.data(), block_size, blocked_offset) == block_size
+                  && matches_pattern(buf.data(), blocked_offset, block_size),
+              "test 26: read succeeds after the pins are released");
+        cout << pinned << " blocks pinned before the cache was full\n";
+        lab2_close(fd);
+
+        free_all_cache_blocks();
+        reset_cache_stats();
+        const Lab2CacheConfig defaults = {180 * block_size, block_size, LAB2_REPLACE_LRU, false, false};
+        lab2_cache_init(&defaults);
+        for (const char* name : names) {
+            remove(name);
+        }
+        cout << "\n----------------------------------------\n\n\n";
+    }
+
+    if (failures > 0) {
+        cout << failures << " check(s) FAILED\n";
+        return 1;
+    }
     return 0;
 }
@@ -1,13 +1,74 @@
 #include "app.h"
+#include "io_backend.h"
+#include "epoch.h"
 #include <iostream>
 #include <random>
 #include <map>
-#include <windows.h>
-
-// Размер блока
+#include <set>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <cstring>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <algorithm>
+#include <climits>
+#include <list>
+#include <utility>
+
+// Размер блока по умолчанию
 #define BLOCK_SIZE 4096
-// Макс кол-во блоков
+// Макс кол-во блоков по умолчанию
 #define MAX_BLOCKS_IN_CACHE 180
+// Допустимые размеры блока
+#define MIN_BLOCK_SIZE (4 * 1024)
+#define MAX_BLOCK_SIZE (1024 * 1024)
+// Сколько лишних блоков вытесняет один промах, пока кэш ужимается до новой ёмкости
+#define SHRINK_EVICTIONS_PER_MISS 8
+// Количество шардов таблицы блоков (у каждого свой замок и свой список LRU)
+#define CACHE_SHARDS 16
+// Сколько блоков с хвоста LRU просматривается в поисках блока файла, превысившего квоту
+#define QUOTA_SCAN_LIMIT 32
+// Запас кадров сверх ёмкости: вытесненные кадры ждут, пока их перестанут читать без замков
+#define GRACE_SPARE_FRAMES CACHE_SHARDS
+// Упреждающее чтение: начальное окно в блоках и предел окна в байтах
+#define READAHEAD_INITIAL_BLOCKS 4
+#define READAHEAD_MAX_BYTES (256 * 1024)
+#define READAHEAD_MAX_BLOCKS (READAHEAD_MAX_BYTES / MIN_BLOCK_SIZE)
+// Больше блоков в один пакет чтения не собирается
+#define READ_BATCH_MAX_BLOCKS 128
+// Потоки фоновой загрузки блоков и предел длины их очереди
+#define PREFETCH_WORKERS 4
+#define PREFETCH_QUEUE_LIMIT 256
+// Фоновая запись по умолчанию: доля "грязных" блоков в процентах и их возраст в мс (как в ядре)
+#define DIRTY_BACKGROUND_RATIO 10
+#define DIRTY_EXPIRE_MS 30000
+// Период пробуждения потока фоновой записи
+#define WRITEBACK_INTERVAL_MS 1000
+// Предел одной записи, в которую объединяются соседние "грязные" блоки, по умолчанию
+#define WRITE_MAX_BYTES (1024 * 1024)
+// Сколько закрытых файлов по умолчанию хранят свои блоки до повторного открытия
+#define CLOSED_FILES_RETAINED 256
+// Файл, изменённый позже чем за столько мс до закрытия, не сохраняет блоки: ФС с грубыми метками времени
+// может не сдвинуть время изменения при следующей записи
+#define MTIME_RACY_MS 100
+// Время изменения впереди часов процесса на столько мс тоже считается свежим: это расхождение часов с ФС
+// (например, сервера NFS). Время дальше в будущем выставлено явно (touch -d) - следующая запись его сдвинет
+#define MTIME_FUTURE_MS 2000
+
+// Текущий размер блока (меняется только при отсутствии открытых файлов)
+size_t block_size = BLOCK_SIZE;
+// Текущая ёмкость кэша в блоках
+std::atomic<size_t> max_blocks_in_cache {MAX_BLOCKS_IN_CACHE};
+// Параметры фоновой записи и текущее число "грязных" блоков
+std::atomic<unsigned> dirty_background_ratio {DIRTY_BACKGROUND_RATIO};
+std::atomic<unsigned> dirty_expire_ms {DIRTY_EXPIRE_MS};
+std::atomic<size_t> max_write_bytes {WRITE_MAX_BYTES};
+std::atomic<size_t> dirty_blocks {0};
 
 std::random_device rd;
 std::mt19937 gen(rd());
@@ -17,83 +78,1103 @@ int get_rand_from_to(int min, int max) {
     return std::uniform_int_distribution<>(min, max)(gen);
 }
 
-// Статистика работы кэша
+// Статистика работы кэша (попадания без замков считаются атомарно)
 struct CacheStats {
-    size_t cache_hits;
-    size_t cache_misses;
+    std::atomic<size_t> cache_hits {0};
+    std::atomic<size_t> cache_misses {0};
+    std::atomic<size_t> readahead_hits {0};  // Обращения к блокам, загруженным упреждающим чтением
+    std::atomic<size_t> readahead_waste {0}; // Такие блоки, покинувшие кэш без единого обращения
+    std::atomic<size_t> dirty_evictions {0}; // Вытеснения, которым пришлось записывать блок на диск
+    std::atomic<size_t> admission_rejects {0}; // Промахи, которые фильтр допуска не пустил в кэш
+};
+
+struct CacheBlock;
+struct FileDescriptor;
+
+// Ссылки блока на соседей в интрузивном списке
+struct BlockLinks {
+    CacheBlock* prev = nullptr;
+    CacheBlock* next = nullptr;
 };
 
-// Инициализация статистики
-CacheStats cache_stats {0, 0};
+// Интрузивный список блоков. Для LRU: в голове - недавно использованные блоки,
+// в хвосте - кандидаты на вытеснение
+struct BlockList {
+    CacheBlock* head = nullptr;
+    CacheBlock* tail = nullptr;
+};
 
-// Кэшблок
+// Кэшблок. Поля, которые читаются без замков, атомарные; их согласованность
+// читатель проверяет по seq
 struct CacheBlock {
-    char* data;         // Указатель на данные
-    bool dirty_data;    // Флаг "грязных" данных (нужно ли записывать на диск)
-    ptrdiff_t useful_data; // Количество полезных данных в блоке
-    ULONGLONG last_used;   // Время последнего использования (для LRU)
+    char* data = nullptr;  // Указатель на данные (буфер из slab-области, закреплён за кадром)
+    std::atomic<uint32_t> seq {1}; // seqlock: нечётное значение - блок меняется или не в кэше
+    std::atomic<bool> referenced {false}; // Было обращение, не учтённое в списках (второй шанс при вытеснении)
+    std::atomic<bool> readahead {false};  // Загружен упреждающим чтением, обращений ещё не было
+    bool dirty_data = false; // Флаг "грязных" данных (нужно ли записывать на диск)
+    unsigned long long dirty_since = 0; // Когда блок стал "грязным" (для фоновой записи)
+    bool loading = false;    // Блок читается с диска фоновым потоком (под замком шарда)
+    bool writeback = false;  // Блок пишется на диск без замка шарда: его не меняют и не вытесняют
+    size_t pins = 0;         // Представления lab2_read_pinned, которые ссылаются на блок: его не вытесняют
+    // Окна lab2_map на запись, в которых показан блок (меняется под замком шарда). Запись через окно
+    // seq не меняет, поэтому такой блок попадания без замков не читают
+    std::atomic<size_t> writable_maps {0};
+    // Блок записан частично без чтения с диска: достоверны только байты [valid_begin; valid_end),
+    // остальные дочитываются при первом обращении к ним
+    std::atomic<bool> partial {false};
+    size_t valid_begin = 0;
+    size_t valid_end = 0;
+    std::atomic<ptrdiff_t> useful_data {0}; // Количество полезных данных в блоке
+    std::atomic<int64_t> block_id {0};           // id блока в файле (нужен при вытеснении из хвоста списка)
+    std::atomic<FileDescriptor*> owner {nullptr}; // Файл, которому принадлежит блок
+    uint64_t retired_epoch = 0; // Эпоха, в которую кадр вернулся в пул
+    BlockLinks file_links; // Соседи в списке блоков файла (под замком blocks_lock файла)
+    BlockLinks lru_links;  // Соседи в списке политики замещения шарда (под замком шарда)
+    bool in_recent = false; // Блок в очереди новых блоков шарда, а не в основном списке (под замком шарда)
+    size_t clock_slot = 0;  // Ячейка блока в кольце CLOCK шарда (под замком шарда)
 };
 
-// Файловый дескриптор для Windows
+// Изменение блока под замком шарда: seq нечётный, пока данные или ключ блока меняются
+void block_write_begin(CacheBlock* block) {
+    block->seq.store(block->seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void block_write_end(CacheBlock* block) {
+    block->seq.store(block->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// Файл в кэше: один на все открытия файла (как inode в ядре), блоки принадлежат ему.
+// Остаётся и после закрытия вместе со своими блоками, пока их не вытеснят
 struct FileDescriptor {
-    HANDLE fd;          // В Windows используется HANDLE
-    int offset; // Смещение в файле (используем LARGE_INTEGER для поддержки больших файлов)
+    // HANDLE (в Windows, int на POSIX) первого открытия: через него идёт ввод-вывод файла.
+    // Открыт, пока открыт файл; при повторном открытии после закрытия меняется
+    std::atomic<HANDLE> fd {INVALID_HANDLE_VALUE};
+    uint64_t id = 0;     // Номер файла в ключах кэша: в отличие от HANDLE, не выдаётся повторно
+    IoFileId file_id {}; // Устройство и inode - ключ в file_table
+    std::atomic<size_t> opens {0}; // Открытия файла (меняется под fd_table_lock, квота читает без замка)
+    // Последнее открытие закрывается (HANDLE файла ещё не закрыт) или удаляются блоки закрытого файла.
+    // lab2_open ждёт, пока флаг не снимут (меняется под fd_table_lock)
+    std::atomic<bool> closing {false};
+    // Ссылки на файл (FileRef и фоновая запись): пока они есть, файл не удаляется из file_table
+    std::atomic<size_t> refs {0};
+    std::atomic<int64_t> size {0}; // Размер файла с учётом блоков, ещё не записанных на диск
+    std::mutex ra_lock;     // Защищает состояние упреждающего чтения: позиционные чтения идут без pos_lock
+    std::mutex blocks_lock; // Защищает список блоков файла
+    BlockList blocks;       // Все блоки файла, которые сейчас в кэше
+    std::atomic<size_t> cached_blocks {0}; // Длина списка blocks
+    // Состояние упреждающего чтения (под ra_lock)
+    Lab2Advice advice = LAB2_ADV_NORMAL; // Подсказка о характере доступа
+    std::atomic<int64_t> ra_last_block {-1}; // Последний прочитанный блок (фоновые потоки только читают)
+    size_t ra_window = 0;       // Текущее окно в блоках, 0 - упреждающее чтение выключено
+    int64_t ra_next_block = 0;  // Первый блок за концом загруженного окна
+    size_t prefetch_requests = 0; // Запросы фоновой загрузки в очереди и в работе (под замком пула)
+    // Индекс "грязных" блоков: fsync, закрытие и фоновая запись не просматривают весь кэш (под blocks_lock)
+    std::set<int64_t> dirty_index;    // id "грязных" блоков по возрастанию смещения
+    size_t writeback_blocks = 0;      // Блоки файла, которые сейчас пишутся на диск
+    std::condition_variable writeback_done; // Запись блока файла завершилась
+    // Неосвобождённые представления lab2_read_pinned и отображения lab2_map. Растёт только под fd_table_lock
+    std::atomic<size_t> pinned_views {0};
+    // Закрытый файл (под fd_table_lock): размер и время изменения при закрытии, по которым повторное
+    // открытие проверяет, что блоки не устарели, и место в списке закрытых файлов
+    int64_t closed_size = -1;
+    int64_t closed_mtime = -1;
+    std::list<FileDescriptor*>::iterator closed_position;
+};
+
+// Смена состояния "грязный"/"чистый" под замком шарда: ведём общий счётчик "грязных" блоков
+// и индекс "грязных" блоков файла
+void mark_block_dirty(CacheBlock* block) {
+    if (!block->dirty_data) {
+        block->dirty_data = true;
+        block->dirty_since = io_tick_ms();
+        dirty_blocks++;
+        FileDescriptor* owner = block->owner;
+        std::lock_guard<std::mutex> blocks_guard(owner->blocks_lock);
+        owner->dirty_index.insert(block->block_id.load(std::memory_order_relaxed));
+    }
+}
+
+void mark_block_clean(CacheBlock* block) {
+    if (block->dirty_data) {
+        block->dirty_data = false;
+        dirty_blocks--;
+        FileDescriptor* owner = block->owner;
+        std::lock_guard<std::mutex> blocks_guard(owner->blocks_lock);
+        owner->dirty_index.erase(block->block_id.load(std::memory_order_relaxed));
+    }
+}
+
+// Текущая политика вытеснения
+std::atomic<Lab2EvictionPolicy> eviction_policy {LAB2_EVICT_GLOBAL};
+// Текущая политика замещения
+std::atomic<Lab2ReplacementPolicy> replacement_policy {LAB2_REPLACE_LRU};
+// Фильтр допуска TinyLFU включён
+std::atomic<bool> admission_filter {false};
+// Чтения не меньше порога (в байтах) идут мимо кэша, 0 - выключено
+std::atomic<size_t> read_bypass_threshold {0};
+// Байты, прочитанные с диска мимо кэша
+std::atomic<int64_t> bypassed_bytes {0};
+// Сколько закрытых файлов хранят свои блоки
+std::atomic<size_t> closed_file_retention {CLOSED_FILES_RETAINED};
+
+// Пара - номер файла (FileDescriptor::id) / id блока, соответствующий отступу в файле
+typedef std::pair<uint64_t, int64_t> CacheKey;
+
+// Хэш ключа: перемешиваем номер файла и id блока (финализатор splitmix64)
+inline uint64_t hash_cache_key(const CacheKey& key) {
+    uint64_t h = key.first * 0x9E3779B97F4A7C15ULL;
+    h ^= static_cast<uint64_t>(key.second) + 0x632BE59BD9B4E019ULL + (h << 6) + (h >> 2);
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    return h ^ (h >> 31);
+}
+
+// Призрачный список: ключи недавно вытесненных блоков без данных, в голове - самые свежие.
+// Промах по такому ключу говорит политике замещения, что блок понадобился повторно.
+// Ключи лежат в кольце в порядке вытеснения, индекс для поиска - открытая адресация с номерами ячеек кольца.
+// Оба массива задаются ёмкостью шарда, как у BlockTable, поэтому вытеснение не выделяет память.
+// Удалённый ключ оставляет в кольце пустую ячейку; кольцо вдвое длиннее предела списка
+// и уплотняется, когда заполнится. Свежий ключ сверх предела вытесняет самый старый
+struct GhostList {
+    std::unique_ptr<CacheKey[]> ring; // Ячейки [tail, head) по модулю длины кольца
+    size_t ring_mask = 0;
+    size_t tail = 0; // Самый старый ключ (или пустая ячейка перед ним)
+    size_t head = 0; // Следующая ячейка для свежего ключа
+    std::unique_ptr<uint32_t[]> index; // Номер ячейки кольца плюс один, 0 - свободно
+    size_t index_mask = 0;
+    size_t count = 0;
+    size_t limit = 0;
+
+    static constexpr int64_t EMPTY = -1; // block_id пустой ячейки кольца
+
+    size_t size() const {
+        return count;
+    }
+
+    // Предел длины списка (под замком шарда). Массивы только растут; при уменьшении лишние старые ключи уходят
+    void set_limit(size_t keys) {
+        size_t ring_size = 1;
+        while (ring_size < keys * 2) {
+            ring_size <<= 1;
+        }
+        if (keys > 0 && (!ring || ring_size > ring_mask + 1)) {
+            std::unique_ptr<CacheKey[]> new_ring(new CacheKey[ring_size]);
+            size_t moved = 0;
+            for (size_t i = tail; i != head; ++i) {
+                if (ring[i & ring_mask].second != EMPTY) {
+                    new_ring[moved++] = ring[i & ring_mask];
+                }
+            }
+            ring = std::move(new_ring);
+            ring_mask = ring_size - 1;
+            tail = 0;
+            head = moved;
+            index.reset(new uint32_t[ring_size]);
+            index_mask = ring_size - 1;
+            rebuild_index();
+        }
+        limit = keys;
+        while (count > limit) {
+            pop_oldest();
+        }
+    }
+
+    void push(const CacheKey& key) {
+        if (limit == 0) {
+            return;
+        }
+        erase(key);
+        if (count == limit) {
+            pop_oldest();
+        }
+        if (head - tail > ring_mask) {
+            compact();
+        }
+        ring[head & ring_mask] = key;
+        index_insert(head & ring_mask);
+        head++;
+        count++;
+    }
+
+    bool contains(const CacheKey& key) const {
+        return find(key) != SIZE_MAX;
+    }
+
+    // true - ключ был в списке
+    bool erase(const CacheKey& key) {
+        const size_t position = find(key);
+        if (position == SIZE_MAX) {
+            return false;
+        }
+        ring[index[position] - 1].second = EMPTY;
+        index_erase(position);
+        count--;
+        return true;
+    }
+
+    void pop_oldest() {
+        while (ring[tail & ring_mask].second == EMPTY) {
+            tail++;
+        }
+        erase(ring[tail & ring_mask]);
+        tail++;
+    }
+
+    void clear() {
+        tail = head = 0;
+        count = 0;
+        if (index) {
+            std::fill_n(index.get(), index_mask + 1, 0);
+        }
+    }
+
+    // Ключи файла, блоки которого устарели
+    void erase_file(uint64_t file) {
+        for (size_t i = tail; i != head; ++i) {
+            const CacheKey& key = ring[i & ring_mask];
+            if (key.second != EMPTY && key.first == file) {
+                erase(key);
+            }
+        }
+    }
+
+private:
+    // Ячейка индекса с ключом или SIZE_MAX
+    size_t find(const CacheKey& key) const {
+        if (count == 0) {
+            return SIZE_MAX;
+        }
+        for (size_t i = hash_cache_key(key) & index_mask; index[i] != 0; i = (i + 1) & index_mask) {
+            if (ring[index[i] - 1] == key) {
+                return i;
+            }
+        }
+        return SIZE_MAX;
+    }
+
+    void index_insert(size_t ring_slot) {
+        size_t i = hash_cache_key(ring[ring_slot]) & index_mask;
+        while (index[i] != 0) {
+            i = (i + 1) & index_mask;
+        }
+        index[i] = static_cast<uint32_t>(ring_slot + 1);
+    }
+
+    // Удаление со сдвигом цепочки назад, как в BlockTable::erase
+    void index_erase(size_t hole) {
+        index[hole] = 0;
+        for (size_t i = (hole + 1) & index_mask; index[i] != 0; i = (i + 1) & index_mask) {
+            const size_t home = hash_cache_key(ring[index[i] - 1]) & index_mask;
+            if (((i - home) & index_mask) >= ((i - hole) & index_mask)) {
+                index[hole] = index[i];
+                index[i] = 0;
+                hole = i;
+            }
+        }
+    }
+
+    // Ключи сдвигаются к хвосту кольца без пустых ячеек, индекс строится заново
+    void compact() {
+        size_t moved = tail;
+        for (size_t i = tail; i != head; ++i) {
+            if (ring[i & ring_mask].second != EMPTY) {
+                ring[moved++ & ring_mask] = ring[i & ring_mask];
+            }
+        }
+        head = moved;
+        rebuild_index();
+    }
+
+    void rebuild_index() {
+        std::fill_n(index.get(), index_mask + 1, 0);
+        count = 0;
+        for (size_t i = tail; i != head; ++i) {
+            index_insert(i & ring_mask);
+            count++;
+        }
+    }
+};
+
+// Ячейка хэш-таблицы: ключ хранится рядом с указателем, чтобы поиск не ходил по памяти блоков.
+// Поля атомарные, потому что попадания ищут блок без замка шарда
+struct BlockSlot {
+    std::atomic<uint64_t> file {0};
+    std::atomic<int64_t> block_id {0};
+    std::atomic<CacheBlock*> block {nullptr}; // nullptr - ячейка свободна
+
+    CacheKey key() const {
+        return {file.load(std::memory_order_relaxed), block_id.load(std::memory_order_relaxed)};
+    }
+};
+
+// Массив ячеек вместе с маской: читатель без замка получает их одним указателем
+struct SlotArray {
+    size_t mask;
+    std::unique_ptr<BlockSlot[]> slots;
+};
+
+void delete_slot_array(void* array) {
+    delete static_cast<SlotArray*>(array);
+}
+
+// Хэш-таблица блоков кэша: открытая адресация с линейным пробированием в плоском массиве.
+// Размер массива задаётся ёмкостью кэша (заполненность не выше 1/2),
+// поэтому вставка не выделяет память, а удаление сдвигает цепочку назад без "надгробий".
+// Меняется только под замком шарда; find_lockfree может промахнуться во время сдвига цепочки
+// или вернуть чужой блок, поэтому найденный блок читатель проверяет сам
+struct BlockTable {
+    std::atomic<SlotArray*> array {nullptr};
+    size_t count = 0;
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    size_t slot_count() const {
+        const SlotArray* slots = array.load(std::memory_order_relaxed);
+        return slots ? slots->mask + 1 : 0;
+    }
+    BlockSlot& slot(size_t index) const {
+        return array.load(std::memory_order_relaxed)->slots[index];
+    }
+
+    // Подготовка массива под заданное число блоков (перехэширование при росте).
+    // Новый массив публикуется целиком, старый освобождается после периода ожидания эпох
+    void reserve(size_t blocks) {
+        size_t capacity = 16;
+        while (capacity < blocks * 2) {
+            capacity <<= 1;
+        }
+        SlotArray* old_slots = array.load(std::memory_order_relaxed);
+        if (old_slots && capacity <= old_slots->mask + 1) {
+            return;
+        }
+        auto* new_slots = new SlotArray{capacity - 1, std::unique_ptr<BlockSlot[]>(new BlockSlot[capacity])};
+        if (old_slots) {
+            for (size_t i = 0; i <= old_slots->mask; ++i) {
+                CacheBlock* block = old_slots->slots[i].block.load(std::memory_order_relaxed);
+                if (block != nullptr) {
+                    place(*new_slots, old_slots->slots[i].key(), block);
+                }
+            }
+        }
+        array.store(new_slots, std::memory_order_release);
+        if (old_slots) {
+            epoch_retire(old_slots, delete_slot_array);
+            epoch_reclaim();
+        }
+    }
+
+    CacheBlock* find(const CacheKey& key) const {
+        const SlotArray* slots = array.load(std::memory_order_relaxed);
+        if (!slots) {
+            return nullptr;
+        }
+        for (size_t i = hash_cache_key(key) & slots->mask; ; i = (i + 1) & slots->mask) {
+            CacheBlock* block = slots->slots[i].block.load(std::memory_order_relaxed);
+            if (block == nullptr) {
+                return nullptr;
+            }
+            if (slots->slots[i].key() == key) {
+                return block;
+            }
+        }
+    }
+
+    // Поиск без замка шарда (вызывается внутри epoch_enter/epoch_exit)
+    CacheBlock* find_lockfree(const CacheKey& key) const {
+        const SlotArray* slots = array.load(std::memory_order_acquire);
+        if (!slots) {
+            return nullptr;
+        }
+        size_t i = hash_cache_key(key) & slots->mask;
+        for (size_t probes = 0; probes <= slots->mask; ++probes, i = (i + 1) & slots->mask) {
+            CacheBlock* block = slots->slots[i].block.load(std::memory_order_acquire);
+            if (block == nullptr) {
+                return nullptr;
+            }
+            if (slots->slots[i].key() == key) {
+                return block;
+            }
+        }
+        return nullptr;
+    }
+
+    void insert(const CacheKey& key, CacheBlock* block) {
+        if ((count + 1) * 2 > slot_count()) {
+            reserve(count + 1);
+        }
+        if (place(*array.load(std::memory_order_relaxed), key, block)) {
+            count++;
+        }
+    }
+
+    void erase(const CacheKey& key) {
+        SlotArray* slots = array.load(std::memory_order_relaxed);
+        if (!slots) {
+            return;
+        }
+        const size_t mask = slots->mask;
+        BlockSlot* cells = slots->slots.get();
+        size_t hole = hash_cache_key(key) & mask;
+        while (cells[hole].block.load(std::memory_order_relaxed) != nullptr && cells[hole].key() != key) {
+            hole = (hole + 1) & mask;
+        }
+        if (cells[hole].block.load(std::memory_order_relaxed) == nullptr) {
+            return; // Ключа нет
+        }
+        cells[hole].block.store(nullptr, std::memory_order_release);
+        count--;
+
+        // Сдвигаем назад элементы цепочки, которые могут занять освободившуюся ячейку
+        for (size_t i = (hole + 1) & mask; cells[i].block.load(std::memory_order_relaxed) != nullptr; i = (i + 1) & mask) {
+            const CacheKey moved_key = cells[i].key();
+            const size_t home = hash_cache_key(moved_key) & mask;
+            if (((i - home) & mask) >= ((i - hole) & mask)) {
+                store_slot(cells[hole], moved_key, cells[i].block.load(std::memory_order_relaxed));
+                cells[i].block.store(nullptr, std::memory_order_release);
+                hole = i;
+            }
+        }
+    }
+
+    void clear() {
+        const size_t slots = slot_count();
+        for (size_t i = 0; i < slots; ++i) {
+            slot(i).block.store(nullptr, std::memory_order_release);
+        }
+        count = 0;
+    }
+
+private:
+    // Запись в свободную ячейку: ключ раньше указателя
+    static void store_slot(BlockSlot& slot, const CacheKey& key, CacheBlock* block) {
+        slot.file.store(key.first, std::memory_order_relaxed);
+        slot.block_id.store(key.second, std::memory_order_relaxed);
+        slot.block.store(block, std::memory_order_release);
+    }
+
+    // Вставка в массив; true - ключ новый
+    static bool place(SlotArray& slots, const CacheKey& key, CacheBlock* block) {
+        size_t i = hash_cache_key(key) & slots.mask;
+        for (;;) {
+            CacheBlock* current = slots.slots[i].block.load(std::memory_order_relaxed);
+            if (current == nullptr) {
+                store_slot(slots.slots[i], key, block);
+                return true;
+            }
+            if (slots.slots[i].key() == key) {
+                slots.slots[i].block.store(block, std::memory_order_release);
+                return false;
+            }
+            i = (i + 1) & slots.mask;
+        }
+    }
+};
+
+// Массив счётчиков частоты: строки подряд, по 16 четырёхбитных счётчиков в слове
+struct SketchArray {
+    size_t mask;           // Счётчиков в строке минус один (степень двойки)
+    size_t words_per_row;
+    std::unique_ptr<std::atomic<uint64_t>[]> words;
+};
+
+void delete_sketch_array(void* array) {
+    delete static_cast<SketchArray*>(array);
+}
+
+// Оценка частоты обращений к блокам для фильтра допуска TinyLFU (count-min sketch): частота ключа -
+// минимум его счётчиков по строкам. Счётчики меняются и без замка шарда (попадания без замков):
+// гонка может потерять приращение, для оценки это неважно. Когда приращений набирается в 10 раз
+// больше, чем счётчиков в строке, все счётчики делятся пополам - старые обращения забываются
+struct FrequencySketch {
+    static constexpr size_t ROWS = 4;
+    static constexpr uint64_t COUNTER_MAX = 15;
+
+    std::atomic<SketchArray*> array {nullptr};
+    std::atomic<size_t> additions {0};
+
+    // Подготовка под заданное число блоков (под замком шарда). Старый массив освобождается после
+    // периода ожидания эпох: его ещё могут обновлять попадания без замков
+    void reserve(size_t blocks) {
+        size_t width = 16;
+        while (width < blocks) {
+            width <<= 1;
+        }
+        SketchArray* old_array = array.load(std::memory_order_relaxed);
+        if (old_array && width <= old_array->mask + 1) {
+            return;
+        }
+        const size_t words_per_row = width / 16;
+        auto* new_array = new SketchArray{width - 1, words_per_row,
+                                          std::unique_ptr<std::atomic<uint64_t>[]>(new std::atomic<uint64_t>[ROWS * words_per_row])};
+        for (size_t i = 0; i < ROWS * words_per_row; ++i) {
+            new_array->words[i].store(0, std::memory_order_relaxed);
+        }
+        additions.store(0, std::memory_order_relaxed);
+        array.store(new_array, std::memory_order_release);
+        if (old_array) {
+            epoch_retire(old_array, delete_sketch_array);
+            epoch_reclaim();
+        }
+    }
+
+    // Слово и сдвиг счётчика ключа в строке row
+    static std::atomic<uint64_t>& counter(const SketchArray& sketch, const CacheKey& key, size_t row, unsigned& shift) {
+        uint64_t h = (hash_cache_key(key) + row * 0x9E3779B97F4A7C15ULL) * 0xBF58476D1CE4E5B9ULL;
+        const size_t index = static_cast<size_t>(h >> 32) & sketch.mask;
+        shift = static_cast<unsigned>(index % 16) * 4;
+        return sketch.words[row * sketch.words_per_row + index / 16];
+    }
+
+    uint32_t estimate(const CacheKey& key) const {
+        const SketchArray* sketch = array.load(std::memory_order_acquire);
+        if (sketch == nullptr) {
+            return 0;
+        }
+        uint64_t frequency = COUNTER_MAX;
+        for (size_t row = 0; row < ROWS; ++row) {
+            unsigned shift;
+            const uint64_t word = counter(*sketch, key, row, shift).load(std::memory_order_relaxed);
+            frequency = std::min(frequency, (word >> shift) & COUNTER_MAX);
+        }
+        return static_cast<uint32_t>(frequency);
+    }
+
+    void increment(const CacheKey& key) {
+        SketchArray* sketch = array.load(std::memory_order_acquire);
+        if (sketch == nullptr) {
+            return;
+        }
+        for (size_t row = 0; row < ROWS; ++row) {
+            unsigned shift;
+            std::atomic<uint64_t>& word = counter(*sketch, key, row, shift);
+            const uint64_t value = word.load(std::memory_order_relaxed);
+            if (((value >> shift) & COUNTER_MAX) < COUNTER_MAX) {
+                word.store(value + (uint64_t(1) << shift), std::memory_order_relaxed);
+            }
+        }
+        const size_t sample = 10 * (sketch->mask + 1);
+        if (additions.fetch_add(1, std::memory_order_relaxed) + 1 == sample) {
+            additions.store(0, std::memory_order_relaxed);
+            for (size_t i = 0; i < ROWS * sketch->words_per_row; ++i) {
+                const uint64_t value = sketch->words[i].load(std::memory_order_relaxed);
+                sketch->words[i].store((value >> 1) & 0x7777777777777777ULL, std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+// Шард кэша: часть таблицы блоков со своим замком, списками политики замещения и статистикой.
+// Блок попадает в шард по старшим битам хэша ключа (младшие биты - индекс ячейки в таблице)
+struct CacheShard {
+    std::mutex lock;
+    BlockTable table;
+    BlockList lru;    // Основной список: весь кэш для LRU, Am для 2Q, T2 для ARC
+    BlockList recent; // Очередь новых блоков: A1in для 2Q, T1 для ARC
+    size_t recent_blocks = 0;
+    GhostList ghost_recent;   // Вытесненные из очереди новых: A1out для 2Q, B1 для ARC
+    GhostList ghost_frequent; // Вытесненные из основного списка: B2 для ARC
+    size_t arc_target = 0;    // Целевая длина T1 в ARC (p), подстраивается по промахам в B1 и B2
+    bool arc_miss_in_frequent = false; // Текущий промах ARC нашёл ключ в B2 (для REPLACE)
+    bool arc_discard_recent = false;   // T1 заполнил шард, B1 пуст: жертва из T1 уходит без призрака
+    // Кольцо CLOCK: блок занимает ячейку от вставки до ухода из кэша, поэтому удаление других блоков
+    // его не сдвигает. Освободившуюся ячейку занимает следующий новый блок - сразу за стрелкой
+    std::vector<CacheBlock*> clock_ring;
+    std::vector<size_t> clock_free_slots;
+    size_t clock_hand = 0;    // Стрелка CLOCK: следующая ячейка кольца
+    FrequencySketch sketch;   // Частоты обращений для фильтра допуска
+    size_t capacity = 1; // Доля общей ёмкости кэша
+    size_t loading_blocks = 0; // Блоки, которые сейчас читаются фоновыми потоками
+    size_t writeback_blocks = 0; // Блоки, которые сейчас пишутся на диск без замка шарда
+    std::condition_variable io_done; // Загрузка или фоновая запись блока шарда завершилась
+    CacheStats stats;
 };
 
-// Пара - HANDLE / id блока, соответствующий отступу в файле
-typedef std::pair<HANDLE, LARGE_INTEGER> CacheKey;
+CacheShard cache_shards[CACHE_SHARDS];
+
+// Шард, в котором живёт блок
+CacheShard& shard_for(const CacheKey& key) {
+    return cache_shards[(hash_cache_key(key) >> 32) % CACHE_SHARDS];
+}
+
+// Ёмкость i-го шарда: общая ёмкость делится поровну, но не меньше одного блока на шард
+size_t shard_capacity(size_t index, size_t total_blocks) {
+    const size_t share = total_blocks / CACHE_SHARDS + (index < total_blocks % CACHE_SHARDS ? 1 : 0);
+    return std::max<size_t>(1, share);
+}
+
+// Пул кадров: метаданные блока вместе с его буфером данных.
+// Буферы нарезаются из одной выровненной области на кусок кадров (slab), которая резервируется
+// при инициализации или росте ёмкости кэша; свободные кадры связаны через file_links.next.
+// Вытесненный кадр сначала попадает в список ожидающих: его ещё может читать попадание без замков,
+// в свободный список он переходит, когда сменятся две эпохи
+struct BlockFrameChunk {
+    std::unique_ptr<CacheBlock[]> frames;
+    char* region;       // Область под буферы
+    size_t region_size; // frames_count * block_size байт
+};
+std::mutex frame_pool_lock;
+std::vector<BlockFrameChunk> block_frame_chunks;
+size_t block_frames_total = 0;
+bool frames_shareable = false; // Кадры на разделяемой памяти: их можно показать в окне lab2_map
+CacheBlock* free_block_frames = nullptr;
+CacheBlock* retired_block_frames = nullptr; // Новые в голове, эпохи убывают к хвосту
+
+// Области пула сообщаются слою ввода-вывода: пакетное чтение закрепляет их в ядре один раз,
+// а не на каждый запрос (вызывается под frame_pool_lock)
+void publish_frame_regions() {
+    std::vector<void*> regions;
+    std::vector<size_t> sizes;
+    for (const BlockFrameChunk& chunk : block_frame_chunks) {
+        regions.push_back(chunk.region);
+        sizes.push_back(chunk.region_size);
+    }
+    io_set_fixed_buffers(regions.data(), sizes.data(), regions.size());
+}
+
+// Довыделение кадров под заданное число блоков (вызывается под frame_pool_lock).
+// Возвращает false, если не удалось зарезервировать память
+bool reserve_block_frames(size_t frames_needed) {
+    if (block_frames_total >= frames_needed) {
+        return true;
+    }
+    const size_t chunk_size = frames_needed - block_frames_total;
+    char* region = static_cast<char*>(io_reserve_region(chunk_size * block_size, frames_shareable));
+    if (!region) {
+        int error = io_last_error();
+        std::cerr << "Cant reserve cache memory. Error code: " << error << std::endl;
+        return false;
+    }
+
+    block_frame_chunks.push_back({std::unique_ptr<CacheBlock[]>(new CacheBlock[chunk_size]), region,
+                                  chunk_size * block_size});
+    CacheBlock* chunk = block_frame_chunks.back().frames.get();
+    for (size_t i = 0; i < chunk_size; ++i) {
+        chunk[i].data = region + i * block_size;
+        chunk[i].file_links.next = free_block_frames;
+        free_block_frames = &chunk[i];
+    }
+    block_frames_total = frames_needed;
+    publish_frame_regions();
+    return true;
+}
+
+// Освобождение всех кадров и их областей (кэш должен быть пуст).
+// Области снимаются с регистрации в слое ввода-вывода до того, как память вернётся системе
+void release_block_frames() {
+    std::lock_guard<std::mutex> pool_guard(frame_pool_lock);
+    std::vector<BlockFrameChunk> chunks;
+    chunks.swap(block_frame_chunks);
+    publish_frame_regions();
+    for (BlockFrameChunk& chunk : chunks) {
+        io_release_region(chunk.region, chunk.region_size);
+    }
+    block_frames_total = 0;
+    free_block_frames = nullptr;
+    retired_block_frames = nullptr;
+}
+
+// Перенос ожидающих кадров, которые уже никто не читает, в свободный список (под frame_pool_lock)
+void reclaim_block_frames() {
+    epoch_try_advance();
+    CacheBlock** link = &retired_block_frames;
+    while (*link != nullptr && !epoch_is_safe((*link)->retired_epoch)) {
+        link = &(*link)->file_links.next;
+    }
+    // Дальше по списку кадры ещё старше - все свободны
+    while (*link != nullptr) {
+        CacheBlock* block = *link;
+        *link = block->file_links.next;
+        block->file_links.next = free_block_frames;
+        free_block_frames = block;
+    }
+}
 
-struct CacheKeyComparator {
-    bool operator()(const CacheKey& lhs, const CacheKey& rhs) const {
-        // Сначала сравниваем HANDLE
-        if (lhs.first != rhs.first) {
-            return lhs.first < rhs.first;
+// Кадр для нового блока: буфер данных уже привязан, выделений памяти нет
+CacheBlock* acquire_block_frame() {
+    std::lock_guard<std::mutex> pool_guard(frame_pool_lock);
+    if (free_block_frames == nullptr) {
+        reclaim_block_frames();
+    }
+    // Читатели без замков выходят из эпохи быстро - дожидаемся их
+    while (free_block_frames == nullptr && retired_block_frames != nullptr) {
+        std::this_thread::yield();
+        reclaim_block_frames();
+    }
+    if (free_block_frames == nullptr) {
+        // Кадров хватает на все доли шардов; сюда попадаем только в гонке с изменением ёмкости
+        if (!reserve_block_frames(block_frames_total + CACHE_SHARDS)) {
+            return nullptr;
         }
-        // Если HANDLE одинаковые, сравниваем LARGE_INTEGER
-        return lhs.second.QuadPart < rhs.second.QuadPart;
     }
+    CacheBlock* block = free_block_frames;
+    free_block_frames = block->file_links.next;
+    // seq остаётся нечётным, пока блок не попадёт в таблицу
+    block->referenced.store(false, std::memory_order_relaxed);
+    block->readahead.store(false, std::memory_order_relaxed);
+    block->dirty_data = false;
+    block->loading = false;
+    block->writeback = false;
+    block->pins = 0;
+    block->partial.store(false, std::memory_order_relaxed);
+    block->valid_begin = block->valid_end = 0;
+    block->useful_data.store(0, std::memory_order_relaxed);
+    block->block_id.store(0, std::memory_order_relaxed);
+    block->owner.store(nullptr, std::memory_order_relaxed);
+    block->file_links = {};
+    block->lru_links = {};
+    block->in_recent = false;
+    return block;
+}
+
+// Возврат кадра в пул: переиспользовать его можно только после периода ожидания.
+// seq кадра к этому моменту нечётный
+void release_block_frame(CacheBlock* block) {
+    std::lock_guard<std::mutex> pool_guard(frame_pool_lock);
+    block->retired_epoch = epoch_current();
+    block->file_links.next = retired_block_frames;
+    retired_block_frames = block;
+}
+
+// Последние закрытия, которые ждут, пока отпустят ссылки на их файлы
+std::atomic<size_t> closes_waiting {0};
+std::mutex file_refs_lock;
+std::condition_variable file_refs_released;
+
+// Снятие ссылки на файл. Без ссылок закрытый файл могут сразу удалить, поэтому после уменьшения
+// счётчика к файлу уже не обращаемся - ожидающие закрытия будятся общей переменной
+void release_file_ref(FileDescriptor& file_desc) {
+    file_desc.refs--;
+    if (closes_waiting > 0) {
+        std::lock_guard<std::mutex> refs_guard(file_refs_lock);
+        file_refs_released.notify_all();
+    }
+}
+
+// Открытие файла (lab2_open): у каждого своё смещение, а файл в кэше общий
+struct OpenFile {
+    FileDescriptor* file = nullptr;
+    int64_t offset = 0;  // Смещение в файле (64 бита: файлы больше 2 ГБ)
+    std::mutex pos_lock; // Сериализует операции, которые двигают offset (как f_pos_lock в ядре)
 };
 
-// Таблица блоков кэша
-std::map<CacheKey, CacheBlock, CacheKeyComparator> cache_table;
+// Таблица открытий (по HANDLE, который вернул lab2_open) и таблица файлов (по устройству и inode).
+// Обе меняются под fd_table_lock
+std::shared_mutex fd_table_lock;
+std::map<HANDLE, std::shared_ptr<OpenFile>> fd_table; // Открытие живёт, пока его держит FileRef
+std::map<IoFileId, FileDescriptor> file_table;
+uint64_t next_file_id = 1;
+// Закрытые файлы из file_table, в голове - закрытые последними
+std::list<FileDescriptor*> closed_files;
+size_t closed_after_sweep = 0; // Длина closed_files после последней уборки
+std::atomic<size_t> open_handles {0}; // Открытия всех файлов (записи fd_table)
+std::condition_variable_any file_closed; // С файла снят флаг closing (ждут под fd_table_lock)
+
+// Ссылка на файл, найденный по HANDLE открытия (как ссылка на struct file в ядре). Пока она жива,
+// закрытие не закрывает HANDLE файла, а сам файл и открытие не удаляются
+struct FileRef {
+    FileDescriptor* file = nullptr;
+    std::shared_ptr<OpenFile> open_file; // Открытие, по HANDLE которого нашли файл
+
+    FileRef() = default;
+    explicit FileRef(FileDescriptor& file_desc) : file(&file_desc) {
+        file_desc.refs++;
+    }
+    FileRef(FileRef&& other) noexcept : file(std::exchange(other.file, nullptr)), open_file(std::move(other.open_file)) {}
+    FileRef& operator=(FileRef&& other) noexcept {
+        std::swap(file, other.file);
+        std::swap(open_file, other.open_file);
+        return *this;
+    }
+    FileRef(const FileRef&) = delete;
+    FileRef& operator=(const FileRef&) = delete;
+    ~FileRef() {
+        if (file != nullptr) {
+            release_file_ref(*file);
+        }
+    }
 
-// Таблица файловых дескрипторов
-std::map<HANDLE, FileDescriptor> fd_table;
-// Таблица блоков кэша
+    FileDescriptor* operator->() const { return file; }
+    FileDescriptor& operator*() const { return *file; }
+    bool operator==(std::nullptr_t) const { return file == nullptr; }
+    bool operator!=(std::nullptr_t) const { return file != nullptr; }
+};
 
-// Получаем файловый дескриптор
-FileDescriptor& get_file_descriptor(const HANDLE fd) {
+// Получаем открытие файла со ссылкой на файл (пустая ссылка, если HANDLE не открыт).
+// pin - сразу закрепить файл для представления или отображения: под замком таблицы это не гоняется
+// с проверкой закреплений в lab2_close
+FileRef get_open_file(const HANDLE fd, bool pin = false) {
+    std::shared_lock<std::shared_mutex> table_guard(fd_table_lock);
     const auto iterator = fd_table.find(fd);
     if (iterator == fd_table.end()) {
-        static FileDescriptor invalid_fd = {nullptr, {-1 } };
-        return invalid_fd;
+        return {};
+    }
+    FileRef file_ref(*iterator->second->file);
+    file_ref.open_file = iterator->second;
+    if (pin) {
+        file_ref->pinned_views++;
     }
-    return iterator->second;
+    return file_ref;
 }
 
-// Выделение памяти под кэшблок (адреса выравнены)
-char* allocate_aligned_buffer() {
-    void* buf = _aligned_malloc(BLOCK_SIZE, BLOCK_SIZE);
-    if (!buf) {
-        DWORD error = GetLastError();
-        std::cerr << "Cant allocate aligned buffer. Windows error code: " << error << std::endl;
-        return nullptr;
+// Получаем файл по HANDLE открытия (пустая ссылка, если HANDLE не открыт)
+FileRef get_file_descriptor(const HANDLE fd, bool pin = false) {
+    return get_open_file(fd, pin);
+}
+
+// Отцепление блока от списка
+void list_unlink(BlockList& list, CacheBlock* block, BlockLinks CacheBlock::* links) {
+    BlockLinks& own = block->*links;
+    if (own.prev) {
+        (own.prev->*links).next = own.next;
+    } else {
+        list.head = own.next;
+    }
+    if (own.next) {
+        (own.next->*links).prev = own.prev;
+    } else {
+        list.tail = own.prev;
     }
-    return static_cast<char*>(buf);
+    own.prev = nullptr;
+    own.next = nullptr;
 }
 
-// Запись кэшблока на диск
-int write_cache_block(HANDLE fd, void* buf, int count, int start_pos) {
-    DWORD bytesWritten;
-    OVERLAPPED overlapped = {0};
-    overlapped.Offset = start_pos;
+// Добавление блока в голову списка
+void list_push_front(BlockList& list, CacheBlock* block, BlockLinks CacheBlock::* links) {
+    BlockLinks& own = block->*links;
+    own.prev = nullptr;
+    own.next = list.head;
+    if (list.head) {
+        (list.head->*links).prev = block;
+    } else {
+        list.tail = block;
+    }
+    list.head = block;
+}
+
+// Блок использован - переносим его в голову списка
+void list_move_front(BlockList& list, CacheBlock* block, BlockLinks CacheBlock::* links) {
+    if (list.head == block) {
+        return;
+    }
+    list_unlink(list, block, links);
+    list_push_front(list, block, links);
+}
+
+// Длина очереди новых блоков 2Q (Kin) и призрачной очереди (Kout): четверть и половина ёмкости шарда
+size_t two_queue_in_limit(const CacheShard& shard) {
+    return std::max<size_t>(1, shard.capacity / 4);
+}
 
-    if (!WriteFile(fd, buf, count, &bytesWritten, &overlapped)) {
-        std::cerr << "Error writing the block cache: " << GetLastError() << std::endl;
+size_t two_queue_out_limit(const CacheShard& shard) {
+    return std::max<size_t>(1, shard.capacity / 2);
+}
+
+// Новый блок занимает место в списках политики замещения. Блок, чей ключ недавно вытеснен,
+// идёт сразу в основной список. Вызывается под замком шарда
+void policy_insert(CacheShard& shard, CacheBlock* block, const CacheKey& key) {
+    bool frequent = true;
+    switch (replacement_policy.load(std::memory_order_relaxed)) {
+    case LAB2_REPLACE_2Q:
+        frequent = shard.ghost_recent.erase(key);
+        break;
+    case LAB2_REPLACE_ARC:
+        // Граница p уже подстроена в arc_prepare_miss
+        frequent = shard.ghost_recent.erase(key) || shard.ghost_frequent.erase(key);
+        break;
+    default:
+        break;
+    }
+
+    block->in_recent = !frequent;
+    if (frequent) {
+        list_push_front(shard.lru, block, &CacheBlock::lru_links);
+    } else {
+        list_push_front(shard.recent, block, &CacheBlock::lru_links);
+        shard.recent_blocks++;
+    }
+
+    // Границы ARC |T1| + |B1| <= c и |T1| + |T2| + |B1| + |B2| <= 2c обычно уже обеспечил arc_prepare_miss.
+    // Нарушаются они, только если ёмкость шарда уменьшилась или жертвой стал блок T1,
+    // переведённый в T2 за попадание без замков
+    if (replacement_policy.load(std::memory_order_relaxed) == LAB2_REPLACE_ARC) {
+        while (shard.ghost_recent.size() > 0 && shard.recent_blocks + shard.ghost_recent.size() > shard.capacity) {
+            shard.ghost_recent.pop_oldest();
+        }
+        while (shard.ghost_recent.size() + shard.ghost_frequent.size() > 0
+               && shard.table.size() + shard.ghost_recent.size() + shard.ghost_frequent.size() > 2 * shard.capacity) {
+            (shard.ghost_frequent.size() > 0 ? shard.ghost_frequent : shard.ghost_recent).pop_oldest();
+        }
+    }
+}
+
+// 2Q и ARC отделяют однократные обращения (сканирование) от повторных; LRU и CLOCK - нет
+bool scan_resistant_policy() {
+    const Lab2ReplacementPolicy policy = replacement_policy.load(std::memory_order_relaxed);
+    return policy == LAB2_REPLACE_2Q || policy == LAB2_REPLACE_ARC;
+}
+
+// Блок - в голову основного списка. Вызывается под замком шарда
+void policy_promote(CacheShard& shard, CacheBlock* block) {
+    if (!block->in_recent) {
+        list_move_front(shard.lru, block, &CacheBlock::lru_links);
+        return;
+    }
+    list_unlink(shard.recent, block, &CacheBlock::lru_links);
+    shard.recent_blocks--;
+    block->in_recent = false;
+    list_push_front(shard.lru, block, &CacheBlock::lru_links);
+}
+
+// Повторное обращение к блоку под замком шарда
+void policy_touch(CacheShard& shard, CacheBlock* block) {
+    // CLOCK порядок блоков не хранит: обращение - только признак для стрелки.
+    // Очередь новых блоков 2Q - FIFO: блок, к которому обращались, переходит в основной список,
+    // только дойдя до её хвоста, - как при попадании без замков
+    const Lab2ReplacementPolicy policy = replacement_policy.load(std::memory_order_relaxed);
+    if (policy == LAB2_REPLACE_CLOCK || (block->in_recent && policy == LAB2_REPLACE_2Q)) {
+        if (!block->referenced.load(std::memory_order_relaxed)) {
+            block->referenced.store(true, std::memory_order_relaxed);
+        }
+        return;
+    }
+    policy_promote(shard, block);
+}
+
+// Вытесняемый блок оставляет ключ в призрачном списке. Вызывается под замком шарда до cache_unlink_block
+void policy_remember(CacheShard& shard, const CacheBlock* block) {
+    const CacheKey key = {block->owner.load(std::memory_order_relaxed)->id,
+                          block->block_id.load(std::memory_order_relaxed)};
+    switch (replacement_policy.load(std::memory_order_relaxed)) {
+    case LAB2_REPLACE_2Q:
+        if (block->in_recent) {
+            shard.ghost_recent.push(key);
+            while (shard.ghost_recent.size() > two_queue_out_limit(shard)) {
+                shard.ghost_recent.pop_oldest();
+            }
+        }
+        break;
+    case LAB2_REPLACE_ARC:
+        if (block->in_recent && shard.arc_discard_recent) {
+            shard.arc_discard_recent = false;
+            break;
+        }
+        (block->in_recent ? shard.ghost_recent : shard.ghost_frequent).push(key);
+        break;
+    default:
+        break;
+    }
+}
+
+// Промах ARC до освобождения места (ARC(c) из статьи Megiddo и Modha, случаи II-IV).
+// Ключ из B1 или B2 сдвигает границу p; новый ключ освобождает место в призрачных списках,
+// чтобы после вставки в T1 выполнялись |T1| + |B1| <= c и |T1| + |T2| + |B1| + |B2| <= 2c.
+// Сам ключ остаётся в призрачном списке до policy_insert. Вызывается под замком шарда
+void arc_prepare_miss(CacheShard& shard, const CacheKey& key) {
+    const size_t c = shard.capacity;
+    const size_t t1 = shard.recent_blocks;
+    const size_t t2 = shard.table.size() - t1;
+    const size_t b1 = shard.ghost_recent.size();
+    const size_t b2 = shard.ghost_frequent.size();
+    shard.arc_miss_in_frequent = false;
+    shard.arc_discard_recent = false;
+    if (shard.ghost_recent.contains(key)) {
+        // Блок ушёл из T1 слишком рано - T1 растёт
+        shard.arc_target = std::min(c, shard.arc_target + std::max<size_t>(1, b2 / b1));
+    } else if (shard.ghost_frequent.contains(key)) {
+        // Блок ушёл из T2 слишком рано - T1 уступает место
+        shard.arc_target -= std::min(shard.arc_target, std::max<size_t>(1, b1 / b2));
+        shard.arc_miss_in_frequent = true;
+    } else if (t1 + b1 >= c) {
+        if (b1 > 0) {
+            shard.ghost_recent.pop_oldest();
+        } else {
+            // T1 занимает весь шард: его старейший блок вытесняется, не оставляя призрака
+            shard.arc_discard_recent = true;
+        }
+    } else if (t1 + t2 + b1 + b2 >= 2 * c && b2 > 0) {
+        shard.ghost_frequent.pop_oldest();
+    }
+}
+
+// Блок занимает ячейку в кольце CLOCK (под замком шарда). Кольцо ведётся при любой политике,
+// чтобы после переключения на CLOCK стрелка видела все блоки. Когда пустых ячеек больше ёмкости шарда
+// (после её уменьшения), кольцо уплотняется начиная со стрелки - порядок обхода сохраняется
+void clock_ring_insert(CacheShard& shard, CacheBlock* block) {
+    if (shard.clock_free_slots.size() > shard.capacity) {
+        std::vector<CacheBlock*> ring;
+        ring.reserve(shard.clock_ring.size() - shard.clock_free_slots.size());
+        for (size_t i = 0; i < shard.clock_ring.size(); ++i) {
+            CacheBlock* other = shard.clock_ring[(shard.clock_hand + i) % shard.clock_ring.size()];
+            if (other != nullptr) {
+                other->clock_slot = ring.size();
+                ring.push_back(other);
+            }
+        }
+        shard.clock_ring.swap(ring);
+        shard.clock_free_slots.clear();
+        shard.clock_hand = 0;
+    }
+    if (shard.clock_free_slots.empty()) {
+        block->clock_slot = shard.clock_ring.size();
+        shard.clock_ring.push_back(block);
+    } else {
+        block->clock_slot = shard.clock_free_slots.back();
+        shard.clock_free_slots.pop_back();
+        shard.clock_ring[block->clock_slot] = block;
+    }
+}
+
+// Новый блок попадает в таблицу и списки политики замещения шарда, а также в список блоков файла.
+// Вызывается под замком шарда. Читателям без замков блок станет виден после block_write_end,
+// когда в нём будут данные
+void cache_link_block(CacheShard& shard, FileDescriptor& file_desc, CacheBlock* block) {
+    block->owner.store(&file_desc, std::memory_order_relaxed);
+    const CacheKey key = {file_desc.id, block->block_id.load(std::memory_order_relaxed)};
+    shard.table.insert(key, block);
+    policy_insert(shard, block, key);
+    clock_ring_insert(shard, block);
+
+    std::lock_guard<std::mutex> blocks_guard(file_desc.blocks_lock);
+    list_push_front(file_desc.blocks, block, &CacheBlock::file_links);
+    file_desc.cached_blocks++;
+}
+
+// Блок покидает кэш, кадр возвращается в пул. Вызывается под замком шарда
+void cache_unlink_block(CacheShard& shard, CacheBlock* block) {
+    block_write_begin(block);
+    if (block->readahead.exchange(false, std::memory_order_relaxed)) {
+        shard.stats.readahead_waste++;
+    }
+    // Блок, сброшенный без записи, больше не считается "грязным"
+    mark_block_clean(block);
+    FileDescriptor* owner = block->owner;
+    shard.table.erase({owner->id, block->block_id.load(std::memory_order_relaxed)});
+    shard.clock_ring[block->clock_slot] = nullptr;
+    shard.clock_free_slots.push_back(block->clock_slot);
+    if (block->in_recent) {
+        list_unlink(shard.recent, block, &CacheBlock::lru_links);
+        shard.recent_blocks--;
+    } else {
+        list_unlink(shard.lru, block, &CacheBlock::lru_links);
+    }
+    {
+        std::lock_guard<std::mutex> blocks_guard(owner->blocks_lock);
+        list_unlink(owner->blocks, block, &CacheBlock::file_links);
+        owner->cached_blocks--;
+    }
+    release_block_frame(block);
+}
+
+// Запись кэшблока на диск
+int write_cache_block(HANDLE fd, void* buf, int count, int64_t start_pos) {
+    ptrdiff_t bytesWritten = io_pwrite(fd, buf, count, start_pos);
+    if (bytesWritten < 0) {
+        std::cerr << "Error writing the block cache: " << io_last_error() << std::endl;
         return -1;
     }
 
-    if (bytesWritten != static_cast<DWORD>(count)) {
+    if (bytesWritten != static_cast<ptrdiff_t>(count)) {
         std::cerr << "Error: Less data was recorded than expected\n";
         return -1;
     }
@@ -101,181 +1182,1665 @@ int write_cache_block(HANDLE fd, void* buf, int count, int start_pos) {
     return 0;
 }
 
-// Освобождение кэшблока
-void free_cache_block(HANDLE found_fd) {
-    if (cache_table.empty()) {
-        return; // Если кэш пуст, ничего не делаем
-    }
+// Запись "грязных" блоков файла по возрастанию смещения: соседние блоки объединяются
+// в одну векторную запись не длиннее max_write_bytes. block_ids отсортированы; пишутся только блоки,
+// ставшие "грязными" не позже dirty_before. На время записи замки шардов не держатся, а блоки
+// помечены writeback. Блоки перестают набираться, когда "грязных" блоков во всём кэше осталось не больше dirty_target
+// (0 - пишутся все подходящие блоки). Возвращает false, если какую-то серию не удалось записать
+// (её блоки остаются "грязными")
+bool write_back_blocks(FileDescriptor& file_desc, const int64_t* block_ids, size_t count, unsigned long long dirty_before,
+                       size_t dirty_target = 0) {
+    const size_t max_run = std::max<size_t>(1, max_write_bytes / block_size);
+    std::vector<CacheBlock*> run;
+    std::vector<IoWriteSegment> segments;
+    bool written_all = true;
+
+    size_t next = 0;
+    while (next < count) {
+        // Набираем серию подряд идущих блоков, помечая их под замками шардов
+        run.clear();
+        segments.clear();
+        int64_t run_start = 0;
+        int64_t run_offset = 0;
+        while (next < count && run.size() < max_run && dirty_blocks.load(std::memory_order_relaxed) > dirty_target) {
+            const int64_t block_id = block_ids[next];
+            // Серия прерывается на разрыве и после неполного блока
+            if (!run.empty() && (block_id != run_start + static_cast<int64_t>(run.size())
+                                 || segments.back().size != block_size)) {
+                break;
+            }
 
-    // Находим блок, который использовался давно (LRU)
-    auto lru_block = cache_table.begin();
-    for (auto it = cache_table.begin(); it != cache_table.end(); ++it) {
-        if (it->first.first == found_fd && it->second.last_used < lru_block->second.last_used) {
-            lru_block = it;
+            const CacheKey key = {file_desc.id, block_id};
+            CacheShard& shard = shard_for(key);
+            std::lock_guard<std::mutex> shard_guard(shard.lock);
+            CacheBlock* block = shard.table.find(key);
+            if (block == nullptr || !block->dirty_data || block->loading || block->writeback
+                || block->dirty_since > dirty_before) {
+                next++;
+                if (run.empty()) {
+                    continue; // Блок уже записан или ещё молод - серия начнётся дальше
+                }
+                break;
+            }
+            // Частично записанный блок пишется отдельной записью своего достоверного диапазона
+            const bool partial = block->partial.load(std::memory_order_relaxed);
+            if (partial && !run.empty()) {
+                break;
+            }
+            next++;
+            if (run.empty()) {
+                run_start = block_id;
+                run_offset = block_id * static_cast<int64_t>(block_size) + (partial ? block->valid_begin : 0);
+            }
+            block->writeback = true;
+            shard.writeback_blocks++;
+            {
+                std::lock_guard<std::mutex> blocks_guard(block->owner.load()->blocks_lock);
+                block->owner.load()->writeback_blocks++;
+            }
+            mark_block_clean(block);
+            run.push_back(block);
+            if (partial) {
+                segments.push_back({block->data + block->valid_begin, block->valid_end - block->valid_begin});
+                break;
+            }
+            segments.push_back({block->data, static_cast<size_t>(block->useful_data.load(std::memory_order_relaxed))});
         }
-    }
-
-    // Если найденный блок принадлежит переданному файловому дескриптору
-    if (lru_block->first.first == found_fd) {
-        // Если данные "грязные", записываем их на диск
-        if (lru_block->second.dirty_data) {
-            if (write_cache_block(
-                    found_fd,
-                    lru_block->second.data,
-                    static_cast<int>(lru_block->second.useful_data),
-                    lru_block->first.second.QuadPart) != 0) {
-                std::cerr << "Ошибка: не удалось записать блок на диск (free_cache_block)\n";
-                return;
-                    }
-            lru_block->second.dirty_data = false; // Сбрасываем флаг "грязных" данных
+        if (run.empty()) {
+            if (dirty_blocks.load(std::memory_order_relaxed) <= dirty_target) {
+                break;
+            }
+            continue;
         }
 
-        // Освобождаем память, выделенную для данных
-        if (lru_block->second.data != nullptr) {
-            _aligned_free(lru_block->second.data);
-            lru_block->second.data = nullptr;
+        size_t expected = 0;
+        for (const IoWriteSegment& segment : segments) {
+            expected += segment.size;
+        }
+        // "Грязные" блоки бывают только у открытого файла, а закрытие дожидается их записи,
+        // поэтому HANDLE файла сейчас открыт
+        const ptrdiff_t written = io_pwritev(file_desc.fd, segments.data(), segments.size(), run_offset);
+        const bool run_written = written == static_cast<ptrdiff_t>(expected);
+        if (!run_written) {
+            std::cerr << "Error writing the block cache: " << io_last_error() << std::endl;
+            written_all = false;
         }
 
-        // Удаляем блок из кэш-таблицы
-        cache_table.erase(lru_block);
+        for (CacheBlock* block : run) {
+            CacheShard& shard = shard_for({file_desc.id, block->block_id.load(std::memory_order_relaxed)});
+            std::lock_guard<std::mutex> shard_guard(shard.lock);
+            block->writeback = false;
+            shard.writeback_blocks--;
+            if (!run_written) {
+                mark_block_dirty(block);
+            }
+            shard.io_done.notify_all();
+            FileDescriptor* owner = block->owner;
+            std::lock_guard<std::mutex> blocks_guard(owner->blocks_lock);
+            if (--owner->writeback_blocks == 0) {
+                owner->writeback_done.notify_all();
+            }
+        }
+    }
+    return written_all;
+}
+
+// Вытеснение блока: записываем "грязные" данные и удаляем блок из кэша. remember - оставить ключ
+// в призрачном списке (блок выбрала политика замещения, а не сбросил пользователь).
+// Вызывается под замком шарда. Возвращает false, если блок не удалось записать на диск
+bool evict_cache_block(CacheShard& shard, CacheBlock* block, bool remember = true) {
+    // Блок, который ещё читается с диска или пишется на него, вытеснять нельзя, как и закреплённый
+    if (block->loading || block->writeback || block->pins > 0) {
+        return false;
+    }
+    // Если данные "грязные", записываем их на диск
+    if (block->dirty_data) {
+        // У частично записанного блока на диск идёт только достоверный диапазон
+        const bool partial = block->partial.load(std::memory_order_relaxed);
+        const size_t begin = partial ? block->valid_begin : 0;
+        const size_t end = partial ? block->valid_end : static_cast<size_t>(block->useful_data.load());
+        if (write_cache_block(
+                block->owner.load()->fd,
+                block->data + begin,
+                static_cast<int>(end - begin),
+                block->block_id * block_size + begin) != 0) {
+            std::cerr << "Ошибка: не удалось записать блок на диск (free_cache_block)\n";
+            return false;
+        }
+        mark_block_clean(block); // Сбрасываем флаг "грязных" данных
+        shard.stats.dirty_evictions++;
+    }
+
+    if (remember) {
+        policy_remember(shard, block);
+    }
+    cache_unlink_block(shard, block);
+    return true;
+}
+
+// Обращение к блоку для фильтра допуска (если он включён)
+void record_access(CacheShard& shard, const CacheKey& key) {
+    if (admission_filter.load(std::memory_order_relaxed)) {
+        shard.sketch.increment(key);
+    }
+}
+
+// Проверка фильтра допуска TinyLFU: промах, которому нужно место, вытесняет жертву политики замещения,
+// только если к его блоку обращались чаще, чем к жертве
+struct Admission {
+    uint32_t frequency;    // Оценка частоты блока-кандидата
+    bool rejected = false; // Кандидат не допущен - вытеснять ничего не нужно
+};
+
+// Вытеснение выбранной политикой жертвы, если её место достаётся кандидату.
+// false - жертва осталась (если admission->rejected, то из-за фильтра)
+bool evict_for_admission(CacheShard& shard, CacheBlock* victim, Admission* admission) {
+    if (admission != nullptr && !victim->loading && !victim->writeback && victim->pins == 0) {
+        const CacheKey victim_key = {victim->owner.load(std::memory_order_relaxed)->id,
+                                     victim->block_id.load(std::memory_order_relaxed)};
+        if (shard.sketch.estimate(victim_key) >= admission->frequency) {
+            admission->rejected = true;
+            shard.stats.admission_rejects++;
+            return false;
+        }
+    }
+    return evict_cache_block(shard, victim);
+}
+
+// Вытеснение с хвоста списка политики замещения. Попадания без замков не двигают блок в списках,
+// а ставят ему признак обращения - такой блок уходит в голову основного списка и остаётся в кэше
+bool evict_from_list(CacheShard& shard, BlockList& list, Admission* admission) {
+    size_t second_chances = shard.table.size();
+    CacheBlock* victim = list.tail;
+    while (victim != nullptr) {
+        CacheBlock* prev = victim->lru_links.prev;
+        if (second_chances > 0 && victim->referenced.exchange(false, std::memory_order_relaxed)) {
+            second_chances--;
+            policy_promote(shard, victim);
+            // Дошли до головы - продолжаем с хвоста, где теперь блоки без признака обращения
+            victim = prev != nullptr ? prev : list.tail;
+            continue;
+        }
+        if (evict_for_admission(shard, victim, admission)) {
+            return true;
+        }
+        if (admission != nullptr && admission->rejected) {
+            return false;
+        }
+        victim = prev;
+    }
+    return false;
+}
+
+// CLOCK: стрелка обходит кольцо блоков шарда. Блок с признаком обращения теряет его
+// и остаётся, первый блок без признака вытесняется. За два оборота признаки снимаются со всех блоков
+bool evict_clock(CacheShard& shard, Admission* admission) {
+    const size_t slots = shard.clock_ring.size();
+    for (size_t step = 0; step < 2 * slots; ++step) {
+        if (shard.clock_hand >= slots) {
+            shard.clock_hand = 0;
+        }
+        CacheBlock* block = shard.clock_ring[shard.clock_hand++];
+        if (block == nullptr || block->referenced.exchange(false, std::memory_order_relaxed)) {
+            continue;
+        }
+        if (evict_for_admission(shard, block, admission)) {
+            return true;
+        }
+        if (admission != nullptr && admission->rejected) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// Квота файла: кэш делится поровну между открытиями, и файл получает долю за каждое своё открытие.
+// У закрытого файла открытий нет - его блоки вытесняются первыми
+size_t file_quota(const FileDescriptor& file_desc) {
+    const size_t opens = file_desc.opens.load(std::memory_order_relaxed);
+    return std::max<size_t>(1, max_blocks_in_cache * opens / std::max<size_t>(1, open_handles));
+}
+
+// Блок файла, превысившего квоту (или самого файла, если квоту превысил он), среди хвоста списка
+bool evict_over_quota(CacheShard& shard, const BlockList& list, const FileDescriptor& file_desc,
+                      bool over_quota, Admission* admission) {
+    size_t scanned = 0;
+    for (CacheBlock* victim = list.tail; victim != nullptr && scanned < QUOTA_SCAN_LIMIT; ++scanned) {
+        CacheBlock* prev = victim->lru_links.prev;
+        const FileDescriptor* owner = victim->owner;
+        const bool preferred = over_quota ? owner == &file_desc : owner->cached_blocks > file_quota(*owner);
+        if (preferred && evict_for_admission(shard, victim, admission)) {
+            return true;
+        }
+        if (admission != nullptr && admission->rejected) {
+            return false;
+        }
+        victim = prev;
+    }
+    return false;
+}
+
+// Квота проверяется на промахе только в его шарде: если своих блоков там нет, файл вытесняет чужой
+// и выходит за квоту. Тогда после чтения или записи он отдаёт блоки, загруженные раньше остальных,
+// из любых шардов. Вызывается без замков
+void trim_file_to_quota(FileDescriptor& file_desc) {
+    if (eviction_policy != LAB2_EVICT_PER_FILE_QUOTA) {
+        return;
+    }
+    const size_t quota = file_quota(file_desc);
+    int64_t block_ids[QUOTA_SCAN_LIMIT];
+    size_t count = 0;
+    {
+        std::lock_guard<std::mutex> blocks_guard(file_desc.blocks_lock);
+        for (CacheBlock* block = file_desc.blocks.tail;
+             block != nullptr && count < QUOTA_SCAN_LIMIT && file_desc.cached_blocks > quota + count;
+             block = block->file_links.prev) {
+            block_ids[count++] = block->block_id.load(std::memory_order_relaxed);
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        const CacheKey key = {file_desc.id, block_ids[i]};
+        CacheShard& shard = shard_for(key);
+        std::lock_guard<std::mutex> shard_guard(shard.lock);
+        CacheBlock* block = shard.table.find(key);
+        if (block != nullptr && block->owner == &file_desc) {
+            evict_cache_block(shard, block);
+        }
+    }
+}
+
+// Освобождение кэшблока шарда согласно политикам вытеснения и замещения.
+// Блоки, которые не удалось записать, пропускаем. Возвращает false, если вытеснить нечего
+// или фильтр допуска (admission, если задан) не пустил кандидата на место жертвы
+bool free_cache_block(CacheShard& shard, const FileDescriptor& file_desc, Admission* admission) {
+    if (eviction_policy == LAB2_EVICT_PER_FILE_QUOTA) {
+        // Каждому открытию - равная доля кэша. Файл, достигший квоты, вытесняет свои блоки,
+        // иначе вытесняются блоки файлов, превысивших квоту
+        const bool over_quota = file_desc.cached_blocks >= file_quota(file_desc);
+        if (evict_over_quota(shard, shard.recent, file_desc, over_quota, admission)
+            || (!(admission != nullptr && admission->rejected)
+                && evict_over_quota(shard, shard.lru, file_desc, over_quota, admission))) {
+            return true;
+        }
+        if (admission != nullptr && admission->rejected) {
+            return false;
+        }
+    }
+
+    // Из какого списка вытеснять. В очереди новых блоков при LRU остаются только блоки,
+    // загруженные до смены политики, - они уходят первыми
+    bool recent_first = shard.recent_blocks > 0;
+    switch (replacement_policy.load(std::memory_order_relaxed)) {
+    case LAB2_REPLACE_2Q:
+        // Очередь новых блоков - FIFO: блоки, прочитанные один раз (сканирование), уходят из неё,
+        // не задевая основной список
+        recent_first = shard.recent_blocks > two_queue_in_limit(shard) || shard.lru.head == nullptr;
+        break;
+    case LAB2_REPLACE_ARC:
+        // REPLACE: из T1, если он длиннее p (или равен p, а промах нашёл ключ в B2), иначе из T2
+        recent_first = shard.recent_blocks > 0
+                       && (shard.arc_discard_recent || shard.recent_blocks > shard.arc_target
+                           || (shard.arc_miss_in_frequent && shard.recent_blocks == shard.arc_target)
+                           || shard.lru.head == nullptr);
+        break;
+    case LAB2_REPLACE_CLOCK:
+        // Стрелка видит все блоки шарда, в каком бы списке они ни были
+        return evict_clock(shard, admission);
+    default:
+        break;
+    }
+    BlockList& first = recent_first ? shard.recent : shard.lru;
+    BlockList& second = recent_first ? shard.lru : shard.recent;
+    if (evict_from_list(shard, first, admission)) {
+        return true;
+    }
+    return !(admission != nullptr && admission->rejected) && evict_from_list(shard, second, admission);
+}
+
+// Освобождаем место под новый блок block_id в шарде. Вызывается под замком шарда.
+// Возвращает false, если ёмкость шарда исчерпана и вытеснить ничего не удалось
+// или фильтр допуска отказал кандидату (admission->rejected)
+bool reserve_cache_slot(CacheShard& shard, const FileDescriptor& file_desc, int64_t block_id,
+                        Admission* admission = nullptr) {
+    if (replacement_policy.load(std::memory_order_relaxed) == LAB2_REPLACE_ARC) {
+        arc_prepare_miss(shard, {file_desc.id, block_id});
+    }
+    // Жёсткий предел на размер шарда. После уменьшения ёмкости лишние блоки
+    // уходят понемногу на каждом промахе, а не разом. Фильтр допуска решает только за первую жертву
+    size_t evicted = 0;
+    while (shard.table.size() >= shard.capacity && evicted < SHRINK_EVICTIONS_PER_MISS
+           && free_cache_block(shard, file_desc, evicted == 0 ? admission : nullptr)) {
+        evicted++;
+    }
+    shard.arc_miss_in_frequent = false;
+    shard.arc_discard_recent = false;
+    if (admission != nullptr && admission->rejected) {
+        return false;
+    }
+    // Пока кэш ужимается, новый блок допускается, если промах вытеснил больше одного блока
+    return shard.table.size() < shard.capacity || evicted > 1;
+}
+
+// Первое обращение к блоку, загруженному упреждающим чтением. true - обращение было первым:
+// для политики замещения оно ещё не повторное
+bool count_readahead_use(CacheShard& shard, CacheBlock* block) {
+    if (block->readahead.load(std::memory_order_relaxed) && block->readahead.exchange(false, std::memory_order_relaxed)) {
+        shard.stats.readahead_hits++;
+        return true;
+    }
+    return false;
+}
+
+// Пул потоков фоновой загрузки. Запрос держит указатель на дескриптор файла,
+// поэтому lab2_close сначала отменяет запросы файла и дожидается выполняемых
+struct PrefetchRequest {
+    FileDescriptor* file;
+    int64_t first_block;
+    size_t count;
+    bool readahead; // Запрос упреждающего чтения (а не lab2_prefetch)
+};
+
+struct PrefetchPool {
+    std::mutex lock;
+    std::condition_variable work_ready; // Появился запрос или пора завершаться
+    std::condition_variable work_done;  // Запрос выполнен
+    std::deque<PrefetchRequest> queue;
+    std::vector<std::thread> workers;
+    size_t active = 0;  // Запросы в работе
+    bool stopping = false;
+
+    ~PrefetchPool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        work_ready.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+};
+PrefetchPool prefetch_pool;
+
+void readahead_blocks(FileDescriptor& file_desc, int64_t first_block, size_t count);
+
+void prefetch_worker() {
+    std::unique_lock<std::mutex> guard(prefetch_pool.lock);
+    for (;;) {
+        prefetch_pool.work_ready.wait(guard, [] {
+            return prefetch_pool.stopping || !prefetch_pool.queue.empty();
+        });
+        if (prefetch_pool.stopping) {
+            return;
+        }
+        PrefetchRequest request = prefetch_pool.queue.front();
+        prefetch_pool.queue.pop_front();
+        prefetch_pool.active++;
+        guard.unlock();
+
+        // Пока запрос упреждающего чтения ждал в очереди, читатель мог уйти вперёд -
+        // уже пройденные блоки не загружаем
+        if (request.readahead) {
+            const int64_t passed = request.file->ra_last_block.load(std::memory_order_relaxed) + 1 - request.first_block;
+            if (passed > 0) {
+                request.first_block += passed;
+                request.count -= std::min<size_t>(request.count, static_cast<size_t>(passed));
+            }
+        }
+        readahead_blocks(*request.file, request.first_block, request.count);
+
+        guard.lock();
+        prefetch_pool.active--;
+        request.file->prefetch_requests--;
+        prefetch_pool.work_done.notify_all();
+    }
+}
+
+void start_prefetch_workers() {
+    std::lock_guard<std::mutex> guard(prefetch_pool.lock);
+    for (size_t i = 0; i < PREFETCH_WORKERS; ++i) {
+        prefetch_pool.workers.emplace_back(prefetch_worker);
+    }
+}
+
+// Постановка загрузки блоков в очередь. Загрузка - лишь подсказка: при переполненной очереди запрос отбрасывается
+void prefetch_enqueue(FileDescriptor& file_desc, int64_t first_block, size_t count, bool readahead) {
+    std::lock_guard<std::mutex> guard(prefetch_pool.lock);
+    if (prefetch_pool.stopping || prefetch_pool.queue.size() >= PREFETCH_QUEUE_LIMIT) {
+        return;
+    }
+    prefetch_pool.queue.push_back({&file_desc, first_block, count, readahead});
+    file_desc.prefetch_requests++;
+    prefetch_pool.work_ready.notify_one();
+}
+
+// Отмена запросов файла перед закрытием: ждём только те, что уже выполняются
+void prefetch_cancel(FileDescriptor& file_desc) {
+    std::unique_lock<std::mutex> guard(prefetch_pool.lock);
+    auto& queue = prefetch_pool.queue;
+    const auto cancelled = std::remove_if(queue.begin(), queue.end(), [&file_desc](const PrefetchRequest& request) {
+        return request.file == &file_desc;
+    });
+    file_desc.prefetch_requests -= static_cast<size_t>(queue.end() - cancelled);
+    queue.erase(cancelled, queue.end());
+    prefetch_pool.work_done.wait(guard, [&file_desc] { return file_desc.prefetch_requests == 0; });
+}
+
+// Поток фоновой записи (как flusher-потоки ядра): "грязный" блок записывается, когда ему исполнилось
+// dirty_expire_ms или когда доля "грязных" блоков превысила dirty_background_ratio.
+// Тогда вытеснение почти всегда находит чистые блоки и не ждёт записи
+struct WritebackDaemon {
+    std::mutex lock;
+    std::condition_variable wake; // Превышена доля "грязных" блоков или пора завершаться
+    std::thread worker;
+    bool stopping = false;
+
+    ~WritebackDaemon() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+};
+WritebackDaemon writeback_daemon;
+
+// Порог числа "грязных" блоков, после которого запись начинается, не дожидаясь их возраста
+size_t dirty_background_blocks() {
+    return max_blocks_in_cache * dirty_background_ratio / 100;
+}
+
+bool dirty_over_background() {
+    return dirty_blocks.load(std::memory_order_relaxed) > dirty_background_blocks();
+}
+
+// Пробуждение потока фоновой записи. Уведомление идёт под его замком: иначе поток, который уже проверил
+// условие, но ещё не заснул, его пропустит
+void wake_writeback_daemon() {
+    std::lock_guard<std::mutex> guard(writeback_daemon.lock);
+    writeback_daemon.wake.notify_one();
+}
+
+// Один проход фоновой записи. Сначала пишутся блоки старше dirty_expire_ms. Если после этого "грязных" блоков
+// больше порога, пишутся и остальные, пока их не станет вдвое меньше порога: запас до порога даёт писателям
+// поработать, прежде чем поток проснётся снова (как и в ядре, порог - точка запуска, а не цель).
+// Блоки берутся из индексов файлов и пишутся в порядке смещений, соседние - одной записью
+void writeback_pass() {
+    const unsigned long long expire = dirty_expire_ms;
+    const unsigned long long now = io_tick_ms();
+    const bool expiry = expire != 0 && now >= expire;
+    if (!expiry && !dirty_over_background()) {
+        return;
+    }
+
+    // Снимок индексов "грязных" блоков файлов. Дальше блоки ищутся по ключу: файл могут закрыть,
+    // пока идёт запись других файлов, а ссылка refs не даёт его удалить
+    std::vector<std::pair<FileDescriptor*, std::vector<int64_t>>> files;
+    {
+        std::shared_lock<std::shared_mutex> table_guard(fd_table_lock);
+        for (auto& [file_id, file_desc] : file_table) {
+            std::lock_guard<std::mutex> blocks_guard(file_desc.blocks_lock);
+            if (!file_desc.dirty_index.empty()) {
+                file_desc.refs++;
+                files.emplace_back(&file_desc, std::vector<int64_t>(file_desc.dirty_index.begin(), file_desc.dirty_index.end()));
+            }
+        }
+    }
+
+    bool written = true;
+    if (expiry) {
+        for (const auto& [file_desc, block_ids] : files) {
+            written = write_back_blocks(*file_desc, block_ids.data(), block_ids.size(), now - expire) && written;
+        }
+    }
+    if (dirty_over_background()) {
+        const size_t dirty_target = dirty_background_blocks() / 2;
+        for (const auto& [file_desc, block_ids] : files) {
+            if (dirty_blocks.load(std::memory_order_relaxed) <= dirty_target) {
+                break;
+            }
+            written = write_back_blocks(*file_desc, block_ids.data(), block_ids.size(), ULLONG_MAX, dirty_target)
+                      && written;
+        }
+    }
+    if (!written) {
+        std::cerr << "Can't flush block (writeback)\n"; // Блоки остаются "грязными", попробуем в следующий раз
+    }
+    for (const auto& [file_desc, block_ids] : files) {
+        release_file_ref(*file_desc);
+    }
+}
+
+// Проход, после которого "грязных" блоков осталось больше порога (запись не удалась или блоки заняты),
+// повторяется по таймеру, а раньше - только если "грязных" блоков с тех пор прибавилось.
+// Иначе неудачная запись крутила бы проходы без перерыва
+void writeback_worker() {
+    std::unique_lock<std::mutex> guard(writeback_daemon.lock);
+    bool backoff = false;
+    size_t dirty_left = 0; // "Грязные" блоки после прошлого прохода
+    for (;;) {
+        writeback_daemon.wake.wait_for(guard, std::chrono::milliseconds(WRITEBACK_INTERVAL_MS), [&] {
+            return writeback_daemon.stopping
+                   || (dirty_over_background() && (!backoff || dirty_blocks.load(std::memory_order_relaxed) > dirty_left));
+        });
+        if (writeback_daemon.stopping) {
+            return;
+        }
+        guard.unlock();
+        writeback_pass();
+        guard.lock();
+        dirty_left = dirty_blocks.load(std::memory_order_relaxed);
+        backoff = dirty_over_background();
+    }
+}
+
+void start_writeback_daemon() {
+    std::lock_guard<std::mutex> guard(writeback_daemon.lock);
+    writeback_daemon.worker = std::thread(writeback_worker);
+}
+
+// Запись всех "грязных" блоков файла по его индексу: соседние блоки уходят одной записью.
+// Дожидается и блоков, которые в это время пишет фоновый поток. -1 - ошибка записи
+int flush_file_blocks(FileDescriptor& file_desc) {
+    std::vector<int64_t> block_ids;
+    {
+        std::lock_guard<std::mutex> blocks_guard(file_desc.blocks_lock);
+        block_ids.assign(file_desc.dirty_index.begin(), file_desc.dirty_index.end());
+    }
+    const bool written = write_back_blocks(file_desc, block_ids.data(), block_ids.size(), ULLONG_MAX);
+
+    std::unique_lock<std::mutex> blocks_guard(file_desc.blocks_lock);
+    file_desc.writeback_done.wait(blocks_guard, [&file_desc] { return file_desc.writeback_blocks == 0; });
+    return written ? 0 : -1;
+}
+
+// Удаление из кэша всех блоков файла (без записи на диск) и его ключей из призрачных списков
+// (блоки устарели: файл изменили, пока он был закрыт).
+// Замок шарда берётся раньше замка файла, поэтому ключ очередного блока сначала копируется
+void drop_file_blocks(FileDescriptor& file_desc) {
+    for (;;) {
+        CacheKey key;
+        {
+            std::lock_guard<std::mutex> blocks_guard(file_desc.blocks_lock);
+            if (file_desc.blocks.head == nullptr) {
+                break;
+            }
+            key = {file_desc.id, file_desc.blocks.head->block_id.load()};
+        }
+
+        CacheShard& shard = shard_for(key);
+        std::unique_lock<std::mutex> shard_guard(shard.lock);
+        CacheBlock* block = shard.table.find(key);
+        if (block != nullptr && block->owner == &file_desc) {
+            // Блок пишет фоновый поток - дожидаемся, кадр ему ещё нужен
+            if (block->writeback) {
+                shard.io_done.wait(shard_guard);
+                continue;
+            }
+            cache_unlink_block(shard, block);
+        }
+    }
+
+    for (CacheShard& shard : cache_shards) {
+        std::lock_guard<std::mutex> shard_guard(shard.lock);
+        shard.ghost_recent.erase_file(file_desc.id);
+        shard.ghost_frequent.erase_file(file_desc.id);
+    }
+}
+
+// Сброс всех блоков кэша (вызывается под fd_table_lock). Блоки, которые сейчас читаются с диска
+// или пишутся на него, остаются: их кадры заняты вводом-выводом. Остаются и закреплённые блоки
+void drop_all_cache_blocks() {
+    std::vector<CacheBlock*> blocks;
+    for (CacheShard& shard : cache_shards) {
+        std::lock_guard<std::mutex> shard_guard(shard.lock);
+        // Удаление сдвигает ячейки таблицы, поэтому блоки сначала собираются
+        blocks.clear();
+        for (size_t i = 0; i < shard.table.slot_count(); ++i) {
+            CacheBlock* block = shard.table.slot(i).block.load(std::memory_order_relaxed);
+            if (block != nullptr && !block->loading && !block->writeback && block->pins == 0) {
+                blocks.push_back(block);
+            }
+        }
+        for (CacheBlock* block : blocks) {
+            cache_unlink_block(shard, block);
+        }
+        // Кэш пуст - прошлые вытеснения больше ничего не говорят о будущих обращениях
+        shard.ghost_recent.clear();
+        shard.ghost_frequent.clear();
+        shard.arc_target = 0;
+        shard.arc_miss_in_frequent = false;
+        shard.arc_discard_recent = false;
+    }
+}
+
+// Удаление закрытого файла из таблиц (вызывается под fd_table_lock). false - на файл ещё есть ссылки refs
+bool erase_closed_file(FileDescriptor& file_desc) {
+    if (file_desc.refs > 0) {
+        return false;
+    }
+    closed_files.erase(file_desc.closed_position);
+    file_table.erase(file_desc.file_id);
+    return true;
+}
+
+// Удаление закрытых файлов, у которых не осталось блоков (вызывается под fd_table_lock).
+// Проход по списку делается, лишь когда он вырос вдвое с прошлой уборки
+void sweep_closed_files(bool force) {
+    if (!force && closed_files.size() < std::max<size_t>(64, 2 * closed_after_sweep)) {
+        return;
+    }
+    for (auto it = closed_files.begin(); it != closed_files.end();) {
+        FileDescriptor& file_desc = **it++;
+        if (file_desc.cached_blocks == 0) {
+            erase_closed_file(file_desc);
+        }
+    }
+    closed_after_sweep = closed_files.size();
+}
+
+// Сверх предела закрытых файлов блоки теряют самые давно закрытые (вызывается под fd_table_lock).
+// Удаление блоков ждёт их ввода-вывода, поэтому здесь файлы только отбираются и помечаются closing,
+// а блоки удаляет drop_closed_files после снятия замка
+void trim_closed_files(std::vector<FileRef>& victims) {
+    const size_t retention = closed_file_retention;
+    size_t excess = closed_files.size() > retention ? closed_files.size() - retention : 0;
+    for (auto it = closed_files.end(); excess > 0 && it != closed_files.begin();) {
+        FileDescriptor& file_desc = **--it;
+        // Файл, уже отобранный другим вызовом, тоже уходит из списка
+        if (!file_desc.closing) {
+            file_desc.closing = true;
+            victims.emplace_back(file_desc);
+        }
+        excess--;
+    }
+}
+
+// Удаление блоков файлов, отобранных trim_closed_files, и самих файлов (вызывается без fd_table_lock)
+void drop_closed_files(std::vector<FileRef>& victims) {
+    if (victims.empty()) {
+        return;
+    }
+    for (const FileRef& victim : victims) {
+        drop_file_blocks(*victim);
+    }
+    std::unique_lock<std::shared_mutex> table_guard(fd_table_lock);
+    for (FileRef& victim : victims) {
+        FileDescriptor& file_desc = *victim;
+        file_desc.closing = false;
+        victim = FileRef();
+        erase_closed_file(file_desc);
+    }
+    file_closed.notify_all();
+}
+
+// Можно ли доверять времени изменения файла при повторном открытии. Не доверяем, если его не прочитать
+// или оно слишком свежее: запись в пределах MTIME_RACY_MS могла не сдвинуть грубую метку времени.
+// Будущее время в пределах MTIME_FUTURE_MS - тоже свежее (расхождение часов), дальше - выставлено явно
+bool mtime_trusted(int64_t mtime) {
+    if (mtime < 0) {
+        return false;
+    }
+    const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    return mtime <= now - static_cast<int64_t>(MTIME_RACY_MS) * 1000000
+           || mtime > now + static_cast<int64_t>(MTIME_FUTURE_MS) * 1000000;
+}
+
+// Последнее открытие закрыто (вызывается под fd_table_lock, изменения файла уже на диске). Чистые блоки
+// остаются в кэше и вытесняются как обычно, а файл запоминает размер и время изменения, чтобы повторное
+// открытие могло им доверять. Блоки файлов сверх предела попадают в victims
+void retain_closed_file(FileDescriptor& file_desc, int64_t size, int64_t mtime, std::vector<FileRef>& victims) {
+    file_desc.closed_size = size;
+    file_desc.closed_mtime = mtime;
+    closed_files.push_front(&file_desc);
+    file_desc.closed_position = closed_files.begin();
+    trim_closed_files(victims);
+    sweep_closed_files(false);
+}
+
+// Повторное открытие закрытого файла (вызывается под fd_table_lock): блоки годятся, только если файл
+// с тех пор не меняли - его размер и время изменения те же, что при закрытии
+void revalidate_closed_file(FileDescriptor& file_desc, HANDLE handle) {
+    closed_files.erase(file_desc.closed_position);
+    if (file_desc.cached_blocks > 0
+        && (io_file_size(handle) != file_desc.closed_size || io_file_mtime(handle) != file_desc.closed_mtime)) {
+        drop_file_blocks(file_desc);
+    }
+}
+
+// Освобождение всех кэшблоков. "Грязные" блоки файлов сначала записываются по их индексам
+void free_all_cache_blocks() {
+    std::unique_lock<std::shared_mutex> table_guard(fd_table_lock);
+    for (auto& [file_id, file_desc] : file_table) {
+        if (flush_file_blocks(file_desc) != 0) {
+            std::cerr << "Can't flush block (free_all_cache_blocks)\n";
+        }
+    }
+    drop_all_cache_blocks();
+    sweep_closed_files(true);
+}
+
+// Изменение ёмкости кэша на ходу. При росте кадры довыделяются сразу,
+// при уменьшении лишние блоки вытесняются постепенно последующими промахами
+int lab2_cache_resize(size_t capacity_bytes) {
+    if (capacity_bytes < block_size) {
+        io_set_invalid_parameter();
+        return -1;
+    }
+    const size_t blocks = capacity_bytes / block_size;
+
+    size_t frames_needed = GRACE_SPARE_FRAMES;
+    for (size_t i = 0; i < CACHE_SHARDS; ++i) {
+        frames_needed += shard_capacity(i, blocks);
+    }
+    {
+        std::lock_guard<std::mutex> pool_guard(frame_pool_lock);
+        if (!reserve_block_frames(frames_needed)) {
+            return -1;
+        }
+    }
+
+    max_blocks_in_cache = blocks;
+    for (size_t i = 0; i < CACHE_SHARDS; ++i) {
+        CacheShard& shard = cache_shards[i];
+        std::lock_guard<std::mutex> shard_guard(shard.lock);
+        shard.capacity = shard_capacity(i, blocks);
+        shard.table.reserve(shard.capacity);
+        shard.sketch.reserve(shard.capacity);
+        // Пределы ARC: |B1| <= c, |B1| + |B2| <= 2c (2Q держит в A1out не больше c / 2)
+        shard.ghost_recent.set_limit(shard.capacity);
+        shard.ghost_frequent.set_limit(2 * shard.capacity);
+    }
+    return 0;
+}
+
+// Инициализация кэша: размер блока и ёмкость.
+// Размер блока можно менять, только пока нет открытых файлов
+int lab2_cache_init(const Lab2CacheConfig* config) {
+    if (!config || config->block_size < MIN_BLOCK_SIZE || config->block_size > MAX_BLOCK_SIZE
+        || (config->block_size & (config->block_size - 1)) != 0 || config->capacity_bytes < config->block_size) {
+        io_set_invalid_parameter();
+        return -1;
+    }
+    // Блок показывается в окне lab2_map отдельным отображением, поэтому не может быть меньше его выравнивания
+    if (config->mappable && config->block_size % io_map_granularity() != 0) {
+        std::cerr << "Block size is smaller than the mapping granularity (lab2_cache_init)\n";
+        io_set_invalid_parameter();
+        return -1;
+    }
+
+    {
+        std::unique_lock<std::shared_mutex> table_guard(fd_table_lock);
+        bool shareable;
+        {
+            std::lock_guard<std::mutex> pool_guard(frame_pool_lock);
+            shareable = frames_shareable;
+        }
+        if (config->block_size != block_size || config->mappable != shareable) {
+            if (!fd_table.empty()) {
+                std::cerr << "Can't change block size or mappable frames while files are open\n";
+                io_set_invalid_parameter();
+                return -1;
+            }
+            // Буферы нарезаны под старый размер блока или лежат не в той памяти - пересоздаём пул.
+            // Файлов нет, значит нет и фоновых загрузок
+            drop_all_cache_blocks();
+            sweep_closed_files(true);
+            release_block_frames();
+            block_size = config->block_size;
+            std::lock_guard<std::mutex> pool_guard(frame_pool_lock);
+            frames_shareable = config->mappable;
+        }
+    }
+
+    if (lab2_cache_resize(config->capacity_bytes) != 0) {
+        return -1;
+    }
+    set_replacement_policy(config->replacement);
+    set_admission_filter(config->admission_filter);
+    return 0;
+}
+
+// Выбор политики вытеснения
+void set_eviction_policy(Lab2EvictionPolicy policy) {
+    eviction_policy = policy;
+}
+
+// Блоки остаются в своих списках: при вытеснении каждая политика разбирает оба списка
+void set_replacement_policy(Lab2ReplacementPolicy policy) {
+    replacement_policy = policy;
+}
+
+void set_admission_filter(bool enabled) {
+    admission_filter = enabled;
+}
+
+void set_read_bypass(size_t threshold_bytes) {
+    read_bypass_threshold = threshold_bytes;
+}
+
+// Уменьшение предела сразу удаляет блоки лишних закрытых файлов
+void set_closed_file_retention(size_t files) {
+    std::vector<FileRef> victims;
+    {
+        std::unique_lock<std::shared_mutex> table_guard(fd_table_lock);
+        closed_file_retention = files;
+        trim_closed_files(victims);
+    }
+    drop_closed_files(victims);
+}
+
+// Параметры фоновой записи
+int lab2_set_writeback(const Lab2WritebackConfig* config) {
+    if (!config || config->dirty_background_ratio > 100 || config->max_write_bytes == 0) {
+        io_set_invalid_parameter();
+        return -1;
+    }
+    dirty_background_ratio = config->dirty_background_ratio;
+    dirty_expire_ms = config->dirty_expire_ms;
+    max_write_bytes = config->max_write_bytes;
+    wake_writeback_daemon();
+    return 0;
+}
+
+// Первое открытие файла: запуск фоновых потоков и, если кэш не инициализирован явно, ёмкость по умолчанию
+void ensure_cache_initialized() {
+    static std::once_flag init_flag;
+    std::call_once(init_flag, [] {
+        bool initialized;
+        {
+            std::lock_guard<std::mutex> pool_guard(frame_pool_lock);
+            initialized = block_frames_total != 0;
+        }
+        if (!initialized) {
+            lab2_cache_resize(max_blocks_in_cache * block_size);
+        }
+        start_prefetch_workers();
+        start_writeback_daemon();
+    });
+}
+
+// Открытие файла
+HANDLE lab2_open(const char* path) {
+    ensure_cache_initialized();
+
+    // Открываем файл средствами платформы (CreateFile / open)
+    HANDLE fd = io_open(path);
+
+    if (fd == INVALID_HANDLE_VALUE) {
+        std::cerr << "Can't open file: " << path << "\n";
+        return INVALID_HANDLE_VALUE;
+    }
+
+    // Все открытия одного файла делят его блоки: файл ищем по устройству и inode
+    IoFileId file_id;
+    if (io_file_id(fd, &file_id) != 0) {
+        std::cerr << "Can't identify file: " << path << "\n";
+        io_close(fd);
+        return INVALID_HANDLE_VALUE;
+    }
+
+    std::unique_lock<std::shared_mutex> table_guard(fd_table_lock);
+    // Пока последнее открытие закрывается, его HANDLE ещё служит файлу, а пока удаляются блоки закрытого
+    // файла, им нельзя доверять - ждём. Закрытый файл могут тем временем удалить из таблицы, поэтому
+    // после ожидания он ищется заново
+    while (file_table[file_id].closing) {
+        file_closed.wait(table_guard);
+    }
+    FileDescriptor& fileDesc = file_table[file_id];
+    if (fileDesc.id == 0) {
+        fileDesc.id = next_file_id++;
+        fileDesc.file_id = file_id;
+    } else if (fileDesc.opens == 0) {
+        revalidate_closed_file(fileDesc, fd);
+    }
+    if (fileDesc.opens == 0) {
+        // Первое открытие (или повторное после закрытия): ввод-вывод идёт через его HANDLE
+        fileDesc.fd = fd;
+        fileDesc.size = std::max<int64_t>(0, io_file_size(fd));
+        {
+            std::lock_guard<std::mutex> ra_guard(fileDesc.ra_lock);
+            fileDesc.advice = LAB2_ADV_NORMAL;
+            fileDesc.ra_last_block = -1;
+            fileDesc.ra_window = 0;
+            fileDesc.ra_next_block = 0;
+        }
+    }
+    fileDesc.opens++;
+    open_handles++;
+    fd_table[fd] = std::make_shared<OpenFile>();
+    fd_table[fd]->file = &fileDesc; // Начальное смещение в файле - 0
+    // Возвращаем HANDLE
+    return fd;
+}
+
+// Отображение lab2_map: окно адресов, в котором подряд показаны буферы закреплённых блоков
+struct FileMapping {
+    FileDescriptor* file_desc = nullptr;
+    char* window = nullptr;
+    size_t window_size = 0;
+    bool writable = false;
+    std::vector<CacheBlock*> blocks; // Закреплённые блоки окна по порядку
+};
+std::mutex mappings_lock;
+std::map<void*, FileMapping> mappings; // Ключ - адрес, который вернул lab2_map
+
+// Запись через отображение кэш не видит: блоки отображения, доступного на запись, помечаются
+// "грязными" целиком. Блок, который сейчас пишет фоновый поток, мог уйти на диск без последних
+// изменений, поэтому пометка ставится после его записи
+void mark_mapping_dirty(const FileMapping& mapping) {
+    if (!mapping.writable) {
+        return;
+    }
+    for (CacheBlock* block : mapping.blocks) {
+        CacheShard& shard = shard_for({mapping.file_desc->id, block->block_id.load(std::memory_order_relaxed)});
+        std::unique_lock<std::mutex> shard_guard(shard.lock);
+        while (block->writeback) {
+            shard.io_done.wait(shard_guard);
+        }
+        mark_block_dirty(block);
+    }
+}
+
+// Синхронизация данных файла (через любое его открытие)
+int sync_file(FileDescriptor& file_desc) {
+    // Изменения, сделанные через отображения файла
+    {
+        std::lock_guard<std::mutex> mappings_guard(mappings_lock);
+        for (const auto& [address, mapping] : mappings) {
+            if (mapping.file_desc == &file_desc) {
+                mark_mapping_dirty(mapping);
+            }
+        }
+    }
+
+    if (flush_file_blocks(file_desc) != 0) {
+        std::cerr << "Can't flush block (fsync)\n";
+        return -1;
+    }
+
+    // Просим устройство сохранить записанные данные
+    if (io_datasync(file_desc.fd) != 0) {
+        std::cerr << "Can't sync file data (fsync)\n";
+        return -1;
+    }
+
+    return 0;
+}
+
+int lab2_fsync(HANDLE fd) {
+    // Получаем файловый дескриптор
+    const FileRef file_desc = get_file_descriptor(fd);
+    if (file_desc == nullptr) {
+        io_set_invalid_handle(); // Устанавливаем ошибку "Invalid handle"
+        return -1;
+    }
+    return sync_file(*file_desc);
+}
+
+// Закрытие файла. Последнее ли это открытие, решается вместе с удалением открытия под замком таблицы,
+// поэтому из двух одновременных закрытий последним окажется ровно одно
+int lab2_close(const HANDLE fd) {
+    FileRef file_desc;
+    HANDLE file_handle;
+    bool last;
+    {
+        std::unique_lock<std::shared_mutex> table_guard(fd_table_lock);
+        const auto iterator = fd_table.find(fd);
+        if (iterator == fd_table.end()) {
+            std::cerr << "Invalid file descriptor\n";
+            return -1;
+        }
+        FileDescriptor& file = *iterator->second->file;
+        // Закреплённые блоки (представления и отображения) ссылаются на файл и читаются через его HANDLE,
+        // поэтому последнее открытие с ними не закрывается. Закрепления растут только под замком таблицы
+        if (file.opens == 1 && file.pinned_views > 0) {
+            std::cerr << "File has pinned views or mappings (lab2_close)\n";
+            io_set_invalid_parameter();
+            return -1;
+        }
+        // Удаляем запись из fd_table до закрытия, чтобы повторно выданный HANDLE получил новую запись
+        fd_table.erase(iterator);
+        file_desc = FileRef(file);
+        file_handle = file.fd;
+        open_handles--;
+        last = --file.opens == 0;
+        file.closing = last;
+    }
+
+    // Фоновые загрузки читают через HANDLE файла - отменяем их
+    if (last) {
+        prefetch_cancel(*file_desc);
+    }
+
+    // Синхронизируем данные перед закрытием. Ошибка записи не мешает закрыть файл, но возвращается вызывающему
+    const bool synced = sync_file(*file_desc) == 0;
+
+    // HANDLE, через который идёт ввод-вывод файла, закрывается только с последним открытием
+    std::vector<HANDLE> handles;
+    if (fd != file_handle) {
+        handles.push_back(fd);
+    }
+    std::vector<FileRef> victims;
+    while (last) {
+        // Изменения всех открытий уже записаны - дожидаемся без замка таблицы фоновой записи и вызовов,
+        // которые ещё держат ссылку на файл (кроме нашей) и идут через его HANDLE
+        {
+            std::unique_lock<std::mutex> refs_guard(file_refs_lock);
+            closes_waiting++;
+            file_refs_released.wait(refs_guard, [&file_desc] { return file_desc->refs == 1; });
+            closes_waiting--;
+        }
+        {
+            std::unique_lock<std::mutex> blocks_guard(file_desc->blocks_lock);
+            file_desc->writeback_done.wait(blocks_guard, [&file_desc] { return file_desc->writeback_blocks == 0; });
+        }
+        // "Грязные" блоки, которые не удалось записать, некуда будет записать после закрытия HANDLE:
+        // они теряются, об этом сообщается, а lab2_close вернёт ошибку
+        bool dirty;
+        {
+            std::lock_guard<std::mutex> blocks_guard(file_desc->blocks_lock);
+            dirty = !file_desc->dirty_index.empty();
+        }
+        if (dirty) {
+            std::cerr << "Dirty blocks of the file are lost on close (lab2_close)\n";
+        }
+        // Блоки файла с недостоверными размером или временем изменения удаляем сразу, тоже без замка таблицы
+        const int64_t size = io_file_size(file_handle);
+        const int64_t mtime = io_file_mtime(file_handle);
+        if (dirty || size < 0 || !mtime_trusted(mtime)) {
+            drop_file_blocks(*file_desc);
+        }
+        std::unique_lock<std::shared_mutex> table_guard(fd_table_lock);
+        {
+            // Фоновая запись могла взять ссылку, пока замка таблицы не было
+            std::lock_guard<std::mutex> blocks_guard(file_desc->blocks_lock);
+            if (file_desc->writeback_blocks != 0 || file_desc->refs != 1 || !file_desc->dirty_index.empty()) {
+                continue;
+            }
+        }
+        file_desc->fd = INVALID_HANDLE_VALUE;
+        handles.push_back(file_handle);
+        file_desc->closing = false;
+        file_closed.notify_all();
+        // Блоки остаются в кэше за файлом: повторное открытие найдёт их по устройству и inode
+        retain_closed_file(*file_desc, size, mtime, victims);
+        break;
+    }
+    // Наша ссылка больше не нужна: закрытый файл может уйти из таблицы вместе с лишними
+    file_desc = FileRef();
+    drop_closed_files(victims);
+
+    // Закрываем файл
+    for (const HANDLE handle : handles) {
+        if (io_close(handle) != 0) {
+            std::cerr << "Failed to close file\n";
+            return -1;
+        }
+    }
+    if (!synced) {
+        return -1; // Ошибку записи уже установил ввод-вывод
+    }
+    return 0; // Успешное закрытие
+}
+
+// Считается ли чтение блока обращением для политики замещения. Для политик, устойчивых к сканированию,
+// не считаются первое чтение блока упреждающего чтения, чтение блока, загруженного этим же вызовом
+// (loaded_here), и повторное чтение того же блока подряд (последовательное чтение мелкими кусками).
+// LRU и CLOCK учитывают любое чтение
+bool counts_as_reference(const FileDescriptor& file_desc, int64_t block_id, bool first_use, bool count_hit) {
+    if (!scan_resistant_policy()) {
+        return true;
+    }
+    return !first_use && count_hit && block_id != file_desc.ra_last_block.load(std::memory_order_relaxed);
+}
+
+// Буфер на блок вне пула, свой у каждого потока: чтение мимо кэша и дочитывание блока идут без выделения
+// памяти. Выровнен так же, как кадры (этого требует чтение в обход системного кэша), и растёт только
+// вместе с размером блока
+struct ThreadBlockBuffer {
+    char* data = nullptr;
+    size_t size = 0;
+
+    ~ThreadBlockBuffer() {
+        ::operator delete(data, std::align_val_t(MIN_BLOCK_SIZE));
+    }
+};
+
+char* thread_block_buffer() {
+    thread_local ThreadBlockBuffer buffer;
+    if (buffer.size < block_size) {
+        ::operator delete(buffer.data, std::align_val_t(MIN_BLOCK_SIZE));
+        buffer.data = static_cast<char*>(::operator new(block_size, std::align_val_t(MIN_BLOCK_SIZE)));
+        buffer.size = block_size;
+    }
+    return buffer.data;
+}
+
+// Чтение части блока мимо кэша (блок не допущен фильтром). Целый выровненный блок читается
+// прямо в буфер вызывающего, иначе - через буфер потока. Как и при загрузке, до конца файла
+// за данными на диске идут нули. Возвращает число прочитанных байт, 0 - конец файла, -1 - ошибка
+ptrdiff_t read_block_uncached(const FileDescriptor& file_desc, int64_t block_id, size_t block_offset,
+                              size_t length, char* dst) {
+    const int64_t block_start = block_id * static_cast<int64_t>(block_size);
+    const bool direct = block_offset == 0 && length == block_size
+                        && reinterpret_cast<uintptr_t>(dst) % MIN_BLOCK_SIZE == 0;
+    char* data = direct ? dst : thread_block_buffer();
+    ptrdiff_t bytes = io_pread(file_desc.fd, data, block_size, block_start);
+    if (bytes < 0) {
+        return -1;
+    }
+    const int64_t file_bytes = file_desc.size.load(std::memory_order_relaxed) - block_start;
+    const ptrdiff_t logical = static_cast<ptrdiff_t>(std::min<int64_t>(std::max<int64_t>(file_bytes, 0), block_size));
+    if (logical > bytes) {
+        memset(data + bytes, 0, logical - bytes);
+        bytes = logical;
+    }
+    const ptrdiff_t available = bytes - static_cast<ptrdiff_t>(block_offset);
+    if (available <= 0) {
+        return 0;
+    }
+    const size_t copied = std::min<size_t>(length, available);
+    if (!direct) {
+        memcpy(dst, data + block_offset, copied);
+    }
+    return static_cast<ptrdiff_t>(copied);
+}
+
+// Дочитывание частично записанного блока: байты вне достоверного диапазона берутся с диска,
+// за концом файла на диске - нули. Вызывается под замком шарда. false - ошибка чтения
+bool fill_partial_block(CacheBlock& block, const FileDescriptor& file_desc) {
+    const int64_t block_start = block.block_id * static_cast<int64_t>(block_size);
+    char* disk = thread_block_buffer();
+    const ptrdiff_t bytes_read = io_pread(file_desc.fd, disk, block_size, block_start);
+    if (bytes_read < 0) {
+        return false;
+    }
+    memset(disk + bytes_read, 0, block_size - bytes_read);
+
+    block_write_begin(&block);
+    memcpy(block.data, disk, block.valid_begin);
+    memcpy(block.data + block.valid_end, disk + block.valid_end, block_size - block.valid_end);
+    // Полезные данные - до конца файла, но не меньше записанного
+    const int64_t file_bytes = file_desc.size.load(std::memory_order_relaxed) - block_start;
+    const ptrdiff_t file_part = static_cast<ptrdiff_t>(std::min<int64_t>(std::max<int64_t>(file_bytes, 0), block_size));
+    block.useful_data.store(std::max<ptrdiff_t>(file_part, block.valid_end), std::memory_order_relaxed);
+    block.partial.store(false, std::memory_order_relaxed);
+    block_write_end(&block);
+    return true;
+}
+
+// Запись начинается за концом файла: хвост последнего блока в кэше становится частью дыры,
+// поэтому дополняется нулями до конца блока
+void pad_tail_block(FileDescriptor& file_desc, int64_t file_size) {
+    const size_t tail = static_cast<size_t>(file_size % static_cast<int64_t>(block_size));
+    if (tail == 0) {
+        return;
+    }
+    const CacheKey key = {file_desc.id, file_size / static_cast<int64_t>(block_size)};
+    CacheShard& shard = shard_for(key);
+    std::unique_lock<std::mutex> shard_guard(shard.lock);
+    CacheBlock* block = shard.table.find(key);
+    while (block != nullptr && (block->loading || block->writeback)) {
+        shard.io_done.wait(shard_guard);
+        block = shard.table.find(key);
+    }
+    // Частичный блок дополнит нулями дочитывание
+    if (block == nullptr || block->partial) {
+        return;
+    }
+    const ptrdiff_t useful = block->useful_data.load(std::memory_order_relaxed);
+    if (useful < static_cast<ptrdiff_t>(block_size)) {
+        block_write_begin(block);
+        memset(block->data + useful, 0, block_size - useful);
+        block->useful_data.store(static_cast<ptrdiff_t>(block_size), std::memory_order_relaxed);
+        block_write_end(block);
+    }
+}
+
+// Попадание без замков: блок ищется в таблице шарда, данные копируются под защитой seqlock блока.
+// Если блок меняется, вытесняется или не найден, копия отбрасывается и вызывающий идёт путём с замком.
+// Возвращает число скопированных байт (0 - в блоке нет данных по этому смещению), -1 - нужен путь с замком.
+// count_hit == false - блок только что загружен промахом, попаданием его не считаем
+ptrdiff_t read_block_lockfree(CacheShard& shard, const FileDescriptor* file_desc, const CacheKey& key,
+                              size_t block_offset, size_t length, char* dst, bool count_hit) {
+    if (!epoch_enter()) {
+        return -1;
+    }
+    ptrdiff_t result = -1;
+    CacheBlock* block = shard.table.find_lockfree(key);
+    if (block != nullptr) {
+        const uint32_t seq = block->seq.load(std::memory_order_acquire);
+        if ((seq & 1) == 0 && block->owner.load(std::memory_order_relaxed) == file_desc
+            && block->block_id.load(std::memory_order_relaxed) == key.second
+            && !block->partial.load(std::memory_order_relaxed)
+            && block->writable_maps.load(std::memory_order_relaxed) == 0) {
+            const ptrdiff_t available_bytes = block->useful_data.load(std::memory_order_relaxed)
+                                              - static_cast<ptrdiff_t>(block_offset);
+            const size_t bytes = available_bytes > 0 ? std::min<size_t>(length, available_bytes) : 0;
+            memcpy(dst, block->data + block_offset, bytes);
+            // Данные скопированы - проверяем, что блок за это время не менялся
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (block->seq.load(std::memory_order_relaxed) == seq) {
+                result = static_cast<ptrdiff_t>(bytes);
+                const bool first_use = count_readahead_use(shard, block);
+                if (counts_as_reference(*file_desc, key.second, first_use, count_hit)
+                    && !block->referenced.load(std::memory_order_relaxed)) {
+                    block->referenced.store(true, std::memory_order_relaxed);
+                }
+                if (count_hit) {
+                    shard.stats.cache_hits.fetch_add(1, std::memory_order_relaxed);
+                    record_access(shard, key);
+                }
+            }
+        }
+    }
+    epoch_exit();
+    return result;
+}
+
+// Предел окна упреждающего чтения: не больше READAHEAD_MAX_BYTES и четверти кэша
+size_t readahead_max_blocks() {
+    return std::max<size_t>(1, std::min<size_t>(READAHEAD_MAX_BYTES / block_size, max_blocks_in_cache / 4));
+}
+
+// Окно растёт, как в Linux: начинается с нескольких блоков и удваивается до предела
+size_t readahead_next_window(size_t window) {
+    return std::min(readahead_max_blocks(), window == 0 ? READAHEAD_INITIAL_BLOCKS : window * 2);
+}
+
+// Блок вставляется в таблицу в состоянии загрузки: читатели дождутся его, а не прочтут повторно.
+// Вызывается под замком шарда, место под блок уже освобождено. nullptr - нет памяти под кадр
+CacheBlock* claim_cache_block(CacheShard& shard, FileDescriptor& file_desc, int64_t block_id, bool readahead) {
+    CacheBlock* frame = acquire_block_frame();
+    if (frame == nullptr) {
+        return nullptr;
+    }
+    frame->block_id.store(block_id, std::memory_order_relaxed);
+    frame->loading = true;
+    if (readahead) {
+        frame->readahead.store(true, std::memory_order_relaxed);
+        // Иначе при LRU и CLOCK блоки, по которым уже прошли попадания, получат второй шанс
+        // раньше ещё не прочитанных блоков окна. Политики, устойчивые к сканированию,
+        // второго шанса непрочитанным блокам не дают
+        if (!scan_resistant_policy()) {
+            frame->referenced.store(true, std::memory_order_relaxed);
+        }
+    }
+    shard.loading_blocks++;
+    cache_link_block(shard, file_desc, frame); // seq остаётся нечётным до конца загрузки
+    return frame;
+}
+
+// Загрузка захваченных блоков одним пакетом чтения: запросы уходят в ядро вместе и завершаются параллельно.
+// Блоки за концом файла и блоки, которые не удалось прочитать, покидают кэш.
+// В first_bytes (если задан) - результат чтения первого блока: 0 - конец файла, -1 - ошибка.
+// Возвращает false, если какой-то блок прочитан не полностью
+bool load_claimed_blocks(FileDescriptor& file_desc, CacheBlock** frames, size_t count, ptrdiff_t* first_bytes) {
+    IoReadRequest requests[READ_BATCH_MAX_BLOCKS];
+    for (size_t i = 0; i < count; ++i) {
+        const int64_t block_id = frames[i]->block_id.load(std::memory_order_relaxed);
+        requests[i] = {frames[i]->data, block_size, block_id * static_cast<int64_t>(block_size), 0};
+    }
+    io_read_batch(file_desc.fd, requests, count);
+
+    bool complete = true;
+    for (size_t i = 0; i < count; ++i) {
+        CacheBlock* frame = frames[i];
+        ptrdiff_t useful = std::max<ptrdiff_t>(requests[i].result, 0);
+        // Файл мог вырасти за счёт блоков, ещё не записанных на диск: до его конца в блоке нули
+        const int64_t file_bytes = file_desc.size.load(std::memory_order_relaxed) - requests[i].offset;
+        const ptrdiff_t logical = static_cast<ptrdiff_t>(std::min<int64_t>(std::max<int64_t>(file_bytes, 0), block_size));
+        if (requests[i].result >= 0 && logical > useful) {
+            memset(frame->data + useful, 0, logical - useful);
+            useful = logical;
+        }
+        if (i == 0 && first_bytes != nullptr) {
+            *first_bytes = requests[0].result < 0 ? -1 : useful;
+        }
+        complete = complete && useful == static_cast<ptrdiff_t>(block_size);
+        CacheShard& shard = shard_for({file_desc.id, frame->block_id.load(std::memory_order_relaxed)});
+        std::lock_guard<std::mutex> shard_guard(shard.lock);
+        frame->useful_data.store(useful, std::memory_order_relaxed);
+        frame->loading = false;
+        shard.loading_blocks--;
+        block_write_end(frame);
+        if (useful == 0) {
+            // Данных нет - это не промах упреждающего чтения, а конец файла
+            frame->readahead.store(false, std::memory_order_relaxed);
+            cache_unlink_block(shard, frame);
+        }
+        shard.io_done.notify_all();
+    }
+    if (count == 0 && first_bytes != nullptr) {
+        *first_bytes = 0;
+    }
+    return complete;
+}
+
+// Упреждающее чтение блоков [first_block; first_block + count): отсутствующие в кэше блоки
+// захватываются и читаются пакетами
+void readahead_blocks(FileDescriptor& file_desc, int64_t first_block, size_t count) {
+    CacheBlock* frames[READ_BATCH_MAX_BLOCKS];
+    size_t claimed = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        const CacheKey key = {file_desc.id, first_block + static_cast<int64_t>(i)};
+        CacheBlock* frame = nullptr;
+        {
+            CacheShard& shard = shard_for(key);
+            std::lock_guard<std::mutex> shard_guard(shard.lock);
+            // Загружаемые блоки занимают не больше половины шарда, чтобы промахам было что вытеснять
+            if (shard.table.find(key) == nullptr && shard.loading_blocks < shard.capacity / 2
+                && reserve_cache_slot(shard, file_desc, key.second)) {
+                frame = claim_cache_block(shard, file_desc, key.second, true);
+            }
+        }
+        if (frame != nullptr) {
+            frames[claimed++] = frame;
+        }
+        if (claimed == READ_BATCH_MAX_BLOCKS) {
+            // Неполный блок - чтение упёрлось в конец файла, дальше загружать нечего
+            if (!load_claimed_blocks(file_desc, frames, claimed, nullptr)) {
+                return;
+            }
+            claimed = 0;
+        }
     }
+    load_claimed_blocks(file_desc, frames, claimed, nullptr);
 }
 
-// Освобождение всех кэшблоков
-void free_all_cache_blocks() {
-    if (cache_table.empty()) {
-        return; // Если кэш пуст, ничего не делаем
+// Учёт обращения к блоку при чтении: последовательный доступ раскручивает окно упреждающего чтения,
+// случайный - схлопывает его.
+// Возвращает, сколько блоков после block_id нужно прочитать сразу, вместе с промахом
+size_t readahead_on_access(FileDescriptor& file_desc, int64_t block_id, bool miss) {
+    std::lock_guard<std::mutex> ra_guard(file_desc.ra_lock);
+    if (file_desc.advice == LAB2_ADV_RANDOM || block_id == file_desc.ra_last_block) {
+        return 0; // Дочитываем тот же блок
     }
-
-    // Проходим по всем элементам кэш-таблицы
-    auto it = cache_table.begin();
-    while (it != cache_table.end()) {
-        if (it->second.data != nullptr) {
-            _aligned_free(it->second.data);
-            it->second.data = nullptr;
-        }
-        // Удаляем блок из кэш-таблицы
-        it = cache_table.erase(it); // erase возвращает итератор на следующий элемент
+    const bool sequential = block_id == file_desc.ra_last_block + 1;
+    file_desc.ra_last_block = block_id;
+    if (!sequential) {
+        file_desc.ra_window = 0;
+        return 0;
     }
-}
 
-// Открытие файла
-HANDLE lab2_open(const char* path) {
-    // Открываем файл с помощью CreateFile
-    HANDLE fd = CreateFile(
-        path,                           // Имя файла
-        GENERIC_READ | GENERIC_WRITE,   // Доступ на чтение и запись
-        0,                              // Не разделяем доступ
-        NULL,                           // Без атрибутов безопасности
-        OPEN_EXISTING,                  // Открываем существующий файл
-        FILE_ATTRIBUTE_NORMAL,          // Обычные атрибуты файла
-        NULL                            // Без шаблона файла
-    );
-
-    if (fd == INVALID_HANDLE_VALUE) {
-        std::cerr << "Can't open file: " << path << "\n";
-        return INVALID_HANDLE_VALUE;
+    int64_t start;
+    if (miss) {
+        // Промах при последовательном чтении - окно читается сразу, читатель всё равно ждёт диск
+        start = block_id + 1;
+    } else if (file_desc.ra_window != 0
+               && file_desc.ra_next_block - block_id <= static_cast<int64_t>(file_desc.ra_window / 2)) {
+        // Прочитана половина окна - подгружаем следующее, пока читатель не дошёл до его конца
+        start = std::max(file_desc.ra_next_block, block_id + 1);
+    } else {
+        return 0;
     }
 
-    // Инициализируем структуру FileDescriptor
-    FileDescriptor fileDesc;
-    fileDesc.fd = fd;
-    fileDesc.offset = 0; // Начальное смещение в файле
-
-    // Сохраняем информацию о файле в fd_table
-    fd_table[fd] = fileDesc;
-    // Возвращаем HANDLE
-    return fd;
+    // При подсказке о последовательном доступе окно сразу максимальное
+    file_desc.ra_window = file_desc.advice == LAB2_ADV_SEQUENTIAL
+                              ? readahead_max_blocks()
+                              : readahead_next_window(file_desc.ra_window);
+    file_desc.ra_next_block = start + static_cast<int64_t>(file_desc.ra_window);
+    if (miss) {
+        return file_desc.ra_window;
+    }
+    // Следующее окно загружается в фоне, пока читатель дочитывает текущее
+    prefetch_enqueue(file_desc, start, file_desc.ra_window, true);
+    return 0;
 }
 
-// Синхронизация данных
-int lab2_fsync(HANDLE fd) {
-    // Получаем файловый дескриптор
-    FileDescriptor& file_desc = get_file_descriptor(fd);
-    if (file_desc.fd == INVALID_HANDLE_VALUE) {
-        SetLastError(ERROR_INVALID_HANDLE); // Устанавливаем ошибку "Invalid handle"
-        return -1;
-    }
+// Блок с данными под замком шарда. Отсутствующий блок загружается (на время чтения замок отпускается),
+// частично записанный - дочитывается. loaded_here - блок загружен этим же вызовом, попаданием его не считаем.
+// nullptr - блок за концом файла (*end_of_file), ошибка чтения или в шарде нет места под блок
+CacheBlock* get_cache_block(CacheShard& shard, std::unique_lock<std::mutex>& shard_guard, FileDescriptor& file_desc,
+                            int64_t block_id, bool loaded_here, bool* end_of_file) {
+    const CacheKey key = {file_desc.id, block_id};
+    for (;;) {
+        CacheBlock* block = shard.table.find(key);
+        while (block != nullptr && block->loading) {
+            shard.io_done.wait(shard_guard);
+            block = shard.table.find(key);
+        }
+        if (block != nullptr) {
+            if (!loaded_here) {
+                shard.stats.cache_hits++;
+                record_access(shard, key);
+            }
+            const bool first_use = count_readahead_use(shard, block);
+            if (block->partial && !fill_partial_block(*block, file_desc)) {
+                return nullptr;
+            }
+            if (counts_as_reference(file_desc, block_id, first_use, !loaded_here)) {
+                policy_touch(shard, block);
+            }
+            return block;
+        }
 
-    // Проходим по всем блокам в кэше
-    for (auto& [key, block] : cache_table) {
-        // Если блок принадлежит текущему файловому дескриптору и помечен как "грязный"
-        if (key.first == fd && block.dirty_data) {
-            block.last_used = GetTickCount64();
-            // Записываем блок на диск
-            if (write_cache_block(fd, block.data, static_cast<int>(block.useful_data), key.second.QuadPart) != 0) {
-                std::cerr << "Can't flush block (fsync)\n";
-                return -1;
+        // Блок вытеснили после пакетной загрузки или для него не нашлось места - загружаем отдельно
+        record_access(shard, key);
+        if (!reserve_cache_slot(shard, file_desc, block_id)) {
+            if (shard.loading_blocks > 0 || shard.writeback_blocks > 0) {
+                shard.io_done.wait(shard_guard);
+                continue;
             }
-            // Сбрасываем флаг "грязных" данных
-            block.dirty_data = false;
+            return nullptr; // Шард занят закреплёнными блоками или блоками, которые не удаётся записать
+        }
+        CacheBlock* frame = claim_cache_block(shard, file_desc, block_id, false);
+        if (frame == nullptr) {
+            return nullptr;
         }
+        shard.stats.cache_misses++;
+        shard_guard.unlock();
+        ptrdiff_t bytes;
+        load_claimed_blocks(file_desc, &frame, 1, &bytes);
+        shard_guard.lock();
+        if (bytes <= 0) {
+            *end_of_file = bytes == 0;
+            return nullptr;
+        }
+        loaded_here = true;
     }
+}
 
-    return 0;
+// Можно ли читать мимо кэша: чтение не меньше порога, начинается на границе блока,
+// а буфер выровнен, как того требует чтение в обход системного кэша
+bool read_bypass_allowed(int64_t position, const char* dst, size_t count) {
+    const size_t threshold = read_bypass_threshold.load(std::memory_order_relaxed);
+    return threshold != 0 && count >= threshold && count >= block_size
+           && position % static_cast<int64_t>(block_size) == 0
+           && reinterpret_cast<uintptr_t>(dst) % MIN_BLOCK_SIZE == 0;
 }
 
-// Закрытие файла
-int lab2_close(const HANDLE fd) {
-    // Проверяем, есть ли дескриптор в таблице
-    auto it = fd_table.find(fd);
-    if (it == fd_table.end()) {
-        std::cerr << "Invalid file descriptor\n";
-        return -1;
+// Есть ли блок в кэше (в том числе загружаемый)
+bool block_cached(const FileDescriptor& file_desc, int64_t block_id) {
+    const CacheKey key = {file_desc.id, block_id};
+    CacheShard& shard = shard_for(key);
+    std::lock_guard<std::mutex> shard_guard(shard.lock);
+    return shard.table.find(key) != nullptr;
+}
+
+// Копирование блока из кэша при чтении мимо кэша. Возвращает число полезных байт блока (0 - конец файла), -1 - ошибка
+ptrdiff_t copy_cached_block(FileDescriptor& file_desc, int64_t block_id, char* dst) {
+    CacheShard& shard = shard_for({file_desc.id, block_id});
+    std::unique_lock<std::mutex> shard_guard(shard.lock);
+    bool end_of_file = false;
+    CacheBlock* block = get_cache_block(shard, shard_guard, file_desc, block_id, false, &end_of_file);
+    if (block == nullptr) {
+        return end_of_file ? 0 : -1;
     }
+    const ptrdiff_t useful = block->useful_data.load(std::memory_order_relaxed);
+    memcpy(dst, block->data, useful);
+    return useful;
+}
 
-    // Синхронизируем данные перед закрытием
-    lab2_fsync(fd);
+// Большое чтение мимо кэша: серии блоков, которых нет в кэше, читаются с диска прямо в буфер вызывающего
+// и кэш не вытесняют. Блоки из кэша (в том числе "грязные") копируются оттуда. Блок, попавший в кэш
+// во время чтения с диска, мог быть изменён записью - его данные тоже берутся из кэша.
+// count кратен размеру блока, position - на границе блока.
+// Возвращает число прочитанных байт (меньше count - конец файла), -1 - ошибка
+ptrdiff_t read_bypass(FileDescriptor& file_desc, int64_t position, char* dst, size_t count) {
+    const size_t blocks = count / block_size;
+    const int64_t first_block = position / static_cast<int64_t>(block_size);
+    size_t done = 0;
+    while (done < blocks) {
+        const int64_t block_id = first_block + static_cast<int64_t>(done);
+        char* block_dst = dst + done * block_size;
+        if (block_cached(file_desc, block_id)) {
+            const ptrdiff_t useful = copy_cached_block(file_desc, block_id, block_dst);
+            if (useful < 0) {
+                return done > 0 ? static_cast<ptrdiff_t>(done * block_size) : -1;
+            }
+            if (useful < static_cast<ptrdiff_t>(block_size)) {
+                return static_cast<ptrdiff_t>(done * block_size) + useful;
+            }
+            done++;
+            continue;
+        }
 
-    // Закрываем файл
-    if (!CloseHandle(fd)) {
-        std::cerr << "Failed to close file\n";
-        return -1;
+        size_t run = 1;
+        while (done + run < blocks && !block_cached(file_desc, block_id + static_cast<int64_t>(run))) {
+            run++;
+        }
+        const size_t run_bytes = run * block_size;
+        const int64_t run_start = block_id * static_cast<int64_t>(block_size);
+        size_t bytes = 0;
+        while (bytes < run_bytes) {
+            const ptrdiff_t result = io_pread(file_desc.fd, block_dst + bytes, run_bytes - bytes,
+                                              run_start + static_cast<int64_t>(bytes));
+            if (result < 0) {
+                return done > 0 ? static_cast<ptrdiff_t>(done * block_size) : -1;
+            }
+            if (result == 0) {
+                break;
+            }
+            bytes += static_cast<size_t>(result);
+        }
+        // Как и при загрузке блоков, до конца файла за данными на диске идут нули
+        const int64_t file_bytes = file_desc.size.load(std::memory_order_relaxed) - run_start;
+        const size_t logical = static_cast<size_t>(std::min<int64_t>(std::max<int64_t>(file_bytes, 0), run_bytes));
+        if (logical > bytes) {
+            memset(block_dst + bytes, 0, logical - bytes);
+            bytes = logical;
+        }
+        bypassed_bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+        const size_t run_blocks = (bytes + block_size - 1) / block_size;
+        for (size_t i = 0; i < run_blocks; ++i) {
+            if (block_cached(file_desc, block_id + static_cast<int64_t>(i))) {
+                const ptrdiff_t useful = copy_cached_block(file_desc, block_id + static_cast<int64_t>(i),
+                                                           block_dst + i * block_size);
+                if (useful < 0) {
+                    return done > 0 ? static_cast<ptrdiff_t>(done * block_size) : -1;
+                }
+            }
+        }
+        if (bytes < run_bytes) {
+            return static_cast<ptrdiff_t>(done * block_size + bytes);
+        }
+        done += run;
     }
+    return static_cast<ptrdiff_t>(count);
+}
 
-    // Удаляем запись из fd_table
-    fd_table.erase(it);
-    return 0; // Успешное закрытие
+// Чтение упёрлось в конец файла - дальше упреждать нечего
+void readahead_stop(FileDescriptor& file_desc) {
+    std::lock_guard<std::mutex> ra_guard(file_desc.ra_lock);
+    file_desc.ra_window = 0;
 }
 
-// Чтение из файла
-ptrdiff_t lab2_read(const HANDLE fd, void *buf, const size_t count) {
-    // Получаем файловый дескриптор и смещение
-    FileDescriptor& file_desc = get_file_descriptor(fd);
-    if (file_desc.fd == INVALID_HANDLE_VALUE || file_desc.offset < 0 || !buf) {
-        SetLastError(ERROR_INVALID_PARAMETER); // Устанавливаем ошибку "Invalid parameter"
-        return -1;
-    }
+// Блоки, загруженные одним пакетом промаха: промах по ним уже учтён, попаданием их не считаем.
+// Векторное чтение передаёт пакет от сегмента к сегменту
+struct ReadBatch {
+    int64_t first = -1;
+    bool claimed[READ_BATCH_MAX_BLOCKS] = {};
+};
 
+// Чтение [position; position + count) через кэш. request_end - конец всего запроса (у векторного чтения -
+// конец последнего сегмента): промах загружает одним пакетом и отсутствующие блоки следующих сегментов.
+// Возвращает число прочитанных байт (меньше count - конец файла), -1 - ошибка
+ptrdiff_t read_range(FileDescriptor& file_desc, int64_t position, char* buffer, size_t count,
+                     int64_t request_end, ReadBatch& batch) {
     ptrdiff_t bytes_read = 0;
-    const auto buffer = static_cast<char*>(buf);
+    // Большое выровненное чтение не вытесняет кэш: целые блоки идут с диска прямо в буфер,
+    // остаток - обычным путём
+    if (read_bypass_allowed(position, buffer, count)) {
+        const size_t aligned = count / block_size * block_size;
+        bytes_read = read_bypass(file_desc, position, buffer, aligned);
+        if (bytes_read < 0) {
+            return -1;
+        }
+        if (bytes_read > 0) {
+            position += bytes_read;
+            std::lock_guard<std::mutex> ra_guard(file_desc.ra_lock);
+            file_desc.ra_last_block = (position - 1) / static_cast<int64_t>(block_size);
+        }
+        if (bytes_read < static_cast<ptrdiff_t>(aligned)) {
+            readahead_stop(file_desc);
+            return bytes_read;
+        }
+    }
 
-    while (bytes_read < count) {
+    while (bytes_read < static_cast<ptrdiff_t>(count)) {
         // Получаем id блока, в который будем читать
-        LARGE_INTEGER block_id;
-        block_id.QuadPart = file_desc.offset / BLOCK_SIZE;
+        const int64_t block_id = position / block_size;
 
         // Отступ внутри кэшблока
-        const size_t block_offset = file_desc.offset % BLOCK_SIZE;
+        const size_t block_offset = position % block_size;
 
         // Сколько байт прочтём на данной итерации
-        // const int iteration_read = static_cast<int>(std::min(BLOCK_SIZE - block_offset, count - bytes_read));
+        // const int iteration_read = static_cast<int>(std::min(block_size - block_offset, count - bytes_read));
         const int iteration_read = static_cast<int>(std::min<ptrdiff_t>(
-            static_cast<ptrdiff_t>(BLOCK_SIZE - block_offset),
+            static_cast<ptrdiff_t>(block_size - block_offset),
             static_cast<ptrdiff_t>(static_cast<ptrdiff_t>(count) - bytes_read)
         ));
-        // Смотрим, есть ли блок в кэше
-        CacheKey key = {fd, block_id};
-        auto cache_iterator = cache_table.find(key);
+        // Смотрим, есть ли блок в кэше: сначала без замков
+        CacheKey key = {file_desc.id, block_id};
+        CacheShard& shard = shard_for(key);
+        const bool loaded_here = batch.first >= 0 && block_id - batch.first < READ_BATCH_MAX_BLOCKS
+                                 && batch.claimed[block_id - batch.first];
         size_t bytes_from_block;
+        const ptrdiff_t lockfree_bytes = read_block_lockfree(shard, &file_desc, key, block_offset,
+                                                             iteration_read, buffer + bytes_read, !loaded_here);
+        if (lockfree_bytes == 0) {
+            break; // Дальше в блоке данных нет
+        }
 
-        if (cache_iterator != cache_table.end()) {
+        std::unique_lock<std::mutex> shard_guard(shard.lock, std::defer_lock);
+        CacheBlock* cached_block = nullptr;
+        if (lockfree_bytes < 0) {
+            shard_guard.lock();
+            cached_block = shard.table.find(key);
+            // Блок ещё читается фоновым потоком - ждём загрузки вместо повторного чтения
+            while (cached_block != nullptr && cached_block->loading) {
+                shard.io_done.wait(shard_guard);
+                cached_block = shard.table.find(key);
+            }
+        }
+
+        if (lockfree_bytes > 0) {
+            bytes_from_block = static_cast<size_t>(lockfree_bytes);
+        } else if (cached_block != nullptr) {
             // Попали в кэшблоки
-            cache_stats.cache_hits++;
+            if (!loaded_here) {
+                shard.stats.cache_hits++;
+                record_access(shard, key);
+            }
 
-            CacheBlock& found_block = cache_iterator->second;
+            CacheBlock& found_block = *cached_block;
+            const bool first_use = count_readahead_use(shard, &found_block);
+            // Блок записан частично - сначала дочитываем остальные байты
+            if (found_block.partial && !fill_partial_block(found_block, file_desc)) {
+                return -1;
+            }
 
-            found_block.last_used = GetTickCount64();
+            if (counts_as_reference(file_desc, block_id, first_use, !loaded_here)) {
+                policy_touch(shard, &found_block);
+            }
             // Получаем количество байт, которое можем прочесть
             ptrdiff_t available_bytes = found_block.useful_data - static_cast<ptrdiff_t>(block_offset);
 
@@ -291,165 +2856,804 @@ ptrdiff_t lab2_read(const HANDLE fd, void *buf, const size_t count) {
             memcpy(buffer + bytes_read, found_block.data + block_offset, bytes_from_block);
         } else {
             // Не попали в кэшблоки
-            cache_stats.cache_misses++;
 
-            // Если место закончилось, то удаляем какой-нибудь уже существующий кэшблок
-            if (cache_table.size() >= MAX_BLOCKS_IN_CACHE) {
-                free_cache_block(fd);
+            // Если место закончилось, то удаляем давно не использованные кэшблоки.
+            // С фильтром допуска место достаётся блоку, только если к нему обращались чаще, чем к жертве
+            record_access(shard, key);
+            Admission admission = {shard.sketch.estimate(key)};
+            if (!reserve_cache_slot(shard, file_desc, block_id, admission_filter ? &admission : nullptr)) {
+                if (admission.rejected) {
+                    // Блок не допущен - читаем его мимо кэша
+                    shard.stats.cache_misses++;
+                    shard_guard.unlock();
+                    const ptrdiff_t bypassed = read_block_uncached(file_desc, block_id, block_offset,
+                                                                   iteration_read, buffer + bytes_read);
+                    if (bypassed <= 0) {
+                        break; // Ошибка чтения или конец файла
+                    }
+                    position += bypassed;
+                    bytes_read += bypassed;
+                    readahead_on_access(file_desc, block_id, false);
+                    continue;
+                }
+                // Шард занят блоками, которые ещё загружаются или пишутся, - дожидаемся их и ищем блок заново
+                if (shard.loading_blocks > 0 || shard.writeback_blocks > 0) {
+                    shard.io_done.wait(shard_guard);
+                    continue;
+                }
+                return -1; // Кэш заполнен блоками, которые не удаётся записать
             }
-
-            // Создаём будущий кэшблок и читаем в него
-            char* aligned_buf = allocate_aligned_buffer();
-            if (!aligned_buf) {
+            // Захватываем блок: параллельные читатели дождутся его загрузки
+            CacheBlock* claimed = claim_cache_block(shard, file_desc, block_id, false);
+            if (!claimed) {
                 return -1; // Ошибка выделения памяти
             }
+            shard.stats.cache_misses++;
+            shard_guard.unlock();
+
+            // В тот же пакет чтения попадают остальные отсутствующие блоки запроса
+            // и, при последовательном доступе, окно упреждающего чтения
+            CacheBlock* frames[READ_BATCH_MAX_BLOCKS];
+            size_t frames_count = 0;
+            frames[frames_count++] = claimed;
+            batch.first = block_id;
+            std::fill(std::begin(batch.claimed), std::end(batch.claimed), false);
+            batch.claimed[0] = true;
+
+            const int64_t request_last = (request_end - 1) / static_cast<int64_t>(block_size);
+            const int64_t readahead_last = block_id + static_cast<int64_t>(readahead_on_access(file_desc, block_id, true));
+            const int64_t batch_last = std::min<int64_t>(std::max(request_last, readahead_last),
+                                                         block_id + READ_BATCH_MAX_BLOCKS - 1);
+            for (int64_t next_block = block_id + 1; next_block <= batch_last; ++next_block) {
+                const bool demand = next_block <= request_last;
+                const CacheKey next_key = {file_desc.id, next_block};
+                CacheShard& next_shard = shard_for(next_key);
+                std::lock_guard<std::mutex> next_guard(next_shard.lock);
+                if (next_shard.table.find(next_key) != nullptr) {
+                    continue; // Уже в кэше или загружается
+                }
+                // Упреждающее чтение занимает не больше половины шарда
+                if ((!demand && next_shard.loading_blocks >= next_shard.capacity / 2)
+                    || !reserve_cache_slot(next_shard, file_desc, next_block)) {
+                    continue;
+                }
+                CacheBlock* frame = claim_cache_block(next_shard, file_desc, next_block, !demand);
+                if (frame == nullptr) {
+                    break;
+                }
+                if (demand) {
+                    next_shard.stats.cache_misses++;
+                    batch.claimed[next_block - block_id] = true;
+                }
+                frames[frames_count++] = frame;
+            }
 
-            // Читаем данные из файла
-            LARGE_INTEGER read_offset;
-            read_offset.QuadPart = block_id.QuadPart * BLOCK_SIZE;
-
-            DWORD bytesRead;
-            if (!ReadFile(fd, aligned_buf, BLOCK_SIZE, &bytesRead, nullptr) || bytesRead == 0) {
-                free(aligned_buf);
+            // Данные разбираются следующими итерациями: блоки уже в кэше
+            ptrdiff_t first_bytes;
+            load_claimed_blocks(file_desc, frames, frames_count, &first_bytes);
+            if (first_bytes <= 0) {
                 break; // Ошибка чтения или конец файла
             }
+            continue;
+        }
 
-            // Создаём блок, записываем в него, сколько данных мы прочли
-            CacheBlock new_block = {aligned_buf, false, static_cast<ptrdiff_t>(bytesRead), GetTickCount64()};
-            cache_table[key] = new_block;
+        // Фиксируем результаты итерации
+        position += bytes_from_block;
+        bytes_read += bytes_from_block;
 
-            // Смотрим, сколько байт сможем прочесть
-            int available_bytes = static_cast<int>(bytesRead) - static_cast<int>(block_offset);
-            if (available_bytes <= 0) {
+        // Упреждающее чтение идёт по другим шардам - замок текущего уже не нужен
+        if (shard_guard.owns_lock()) {
+            shard_guard.unlock();
+        }
+        readahead_on_access(file_desc, block_id, false);
+    }
+
+    // Дочитали до конца файла - дальше упреждать нечего
+    if (bytes_read < static_cast<ptrdiff_t>(count)) {
+        readahead_stop(file_desc);
+    }
+    trim_file_to_quota(file_desc);
+    return bytes_read;
+}
+
+// Чтение из файла с текущего смещения
+ptrdiff_t lab2_read(const HANDLE fd, void *buf, const size_t count) {
+    // Получаем открытие файла и смещение
+    const FileRef file_ref = get_open_file(fd);
+    OpenFile* open_file = file_ref.open_file.get();
+    if (open_file == nullptr || !buf) {
+        io_set_invalid_parameter(); // Устанавливаем ошибку "Invalid parameter"
+        return -1;
+    }
+    std::lock_guard<std::mutex> pos_guard(open_file->pos_lock);
+    if (open_file->offset < 0) {
+        io_set_invalid_parameter();
+        return -1;
+    }
+
+    ReadBatch batch;
+    const ptrdiff_t bytes_read = read_range(*open_file->file, open_file->offset, static_cast<char*>(buf), count,
+                                            open_file->offset + static_cast<int64_t>(count), batch);
+    if (bytes_read > 0) {
+        open_file->offset += bytes_read;
+    }
+    return bytes_read;
+}
+
+// Позиционное чтение: смещение файла не меняется, поэтому потоки читают один дескриптор без pos_lock
+ptrdiff_t lab2_pread(const HANDLE fd, void* buf, const size_t count, const int64_t offset) {
+    const FileRef file_desc = get_file_descriptor(fd);
+    if (file_desc == nullptr || !buf || offset < 0) {
+        io_set_invalid_parameter();
+        return -1;
+    }
+    ReadBatch batch;
+    return read_range(*file_desc, offset, static_cast<char*>(buf), count, offset + static_cast<int64_t>(count), batch);
+}
+
+// Векторное позиционное чтение: сегменты заполняются подряд с offset. Промахи всех сегментов
+// загружаются общими пакетами. Возвращает число прочитанных байт (меньше суммы длин - конец файла)
+ptrdiff_t lab2_preadv(const HANDLE fd, const Lab2IoVec* iov, const int iovcnt, const int64_t offset) {
+    const FileRef file_desc = get_file_descriptor(fd);
+    if (file_desc == nullptr || (iov == nullptr && iovcnt != 0) || iovcnt < 0 || offset < 0) {
+        io_set_invalid_parameter();
+        return -1;
+    }
+    int64_t request_end = offset;
+    for (int i = 0; i < iovcnt; ++i) {
+        if (iov[i].base == nullptr && iov[i].length != 0) {
+            io_set_invalid_parameter();
+            return -1;
+        }
+        request_end += static_cast<int64_t>(iov[i].length);
+    }
+
+    ReadBatch batch;
+    ptrdiff_t total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        const ptrdiff_t bytes = read_range(*file_desc, offset + total, static_cast<char*>(iov[i].base),
+                                           iov[i].length, request_end, batch);
+        if (bytes < 0) {
+            return total > 0 ? total : -1;
+        }
+        total += bytes;
+        if (bytes < static_cast<ptrdiff_t>(iov[i].length)) {
+            break; // Конец файла
+        }
+    }
+    return total;
+}
+
+// Представление lab2_read_pinned: куски для вызывающего и блоки, которые они закрепляют
+struct PinnedView {
+    FileDescriptor* file_desc = nullptr;
+    std::vector<Lab2Span> spans;
+    std::vector<CacheBlock*> blocks;
+};
+
+// Отсутствующие в кэше блоки [first_block; last_block] (не больше READ_BATCH_MAX_BLOCKS) захватываются
+// и читаются одним пакетом, как промахи lab2_read. Загруженные блоки отмечаются в loaded_here.
+// Блок, для которого не нашлось места, остаётся на get_cache_block
+void load_missing_blocks(FileDescriptor& file_desc, int64_t first_block, int64_t last_block, bool* loaded_here) {
+    CacheBlock* frames[READ_BATCH_MAX_BLOCKS];
+    size_t frames_count = 0;
+    for (int64_t block_id = first_block; block_id <= last_block; ++block_id) {
+        const CacheKey key = {file_desc.id, block_id};
+        CacheShard& shard = shard_for(key);
+        std::lock_guard<std::mutex> shard_guard(shard.lock);
+        if (shard.table.find(key) != nullptr) {
+            continue;
+        }
+        record_access(shard, key);
+        if (!reserve_cache_slot(shard, file_desc, block_id)) {
+            continue;
+        }
+        CacheBlock* frame = claim_cache_block(shard, file_desc, block_id, false);
+        if (frame == nullptr) {
+            break;
+        }
+        shard.stats.cache_misses++;
+        loaded_here[block_id - first_block] = true;
+        frames[frames_count++] = frame;
+    }
+    load_claimed_blocks(file_desc, frames, frames_count, nullptr);
+}
+
+// Снятие закрепления с блоков представления
+void unpin_blocks(const FileDescriptor& file_desc, const std::vector<CacheBlock*>& blocks, bool writable = false) {
+    for (CacheBlock* block : blocks) {
+        CacheShard& shard = shard_for({file_desc.id, block->block_id.load(std::memory_order_relaxed)});
+        std::lock_guard<std::mutex> shard_guard(shard.lock);
+        block->pins--;
+        if (writable) {
+            block->writable_maps.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+// Чтение без копирования: [offset; offset + count) разбивается на куски по блокам кэша, блоки закрепляются.
+// Отсутствующие блоки загружаются пакетами, как промахи lab2_read. Смещение файла и упреждающее чтение не меняются
+int lab2_read_pinned(const HANDLE fd, const int64_t offset, const size_t count, Lab2PinnedView* view) {
+    if (view == nullptr || offset < 0) {
+        io_set_invalid_parameter();
+        return -1;
+    }
+    const FileRef file_desc = get_file_descriptor(fd, true);
+    if (file_desc == nullptr) {
+        io_set_invalid_parameter();
+        return -1;
+    }
+
+    auto pinned = std::make_unique<PinnedView>();
+    pinned->file_desc = file_desc.file;
+    const int64_t end = offset + static_cast<int64_t>(count);
+    int64_t position = offset;
+    bool end_of_file = false;
+
+    while (position < end && !end_of_file) {
+        const int64_t first_block = position / static_cast<int64_t>(block_size);
+        const int64_t last_block = std::min<int64_t>((end - 1) / static_cast<int64_t>(block_size),
+                                                     first_block + READ_BATCH_MAX_BLOCKS - 1);
+
+        bool loaded_here[READ_BATCH_MAX_BLOCKS] = {};
+        load_missing_blocks(*file_desc, first_block, last_block, loaded_here);
+
+        for (int64_t block_id = first_block; block_id <= last_block && !end_of_file; ++block_id) {
+            CacheShard& shard = shard_for({file_desc->id, block_id});
+            std::unique_lock<std::mutex> shard_guard(shard.lock);
+            CacheBlock* block = get_cache_block(shard, shard_guard, *file_desc, block_id,
+                                                loaded_here[block_id - first_block], &end_of_file);
+            if (block == nullptr) {
+                if (end_of_file) {
+                    break;
+                }
+                shard_guard.unlock();
+                unpin_blocks(*file_desc, pinned->blocks);
+                file_desc->pinned_views--;
+                return -1;
+            }
+            const size_t block_offset = static_cast<size_t>(position % static_cast<int64_t>(block_size));
+            const ptrdiff_t useful = block->useful_data.load(std::memory_order_relaxed);
+            const ptrdiff_t available = useful - static_cast<ptrdiff_t>(block_offset);
+            if (available <= 0) {
+                end_of_file = true;
+                break;
+            }
+            const size_t bytes = std::min<size_t>(available, static_cast<size_t>(end - position));
+            block->pins++;
+            pinned->spans.push_back({block->data + block_offset, bytes});
+            pinned->blocks.push_back(block);
+            position += static_cast<int64_t>(bytes);
+            // Неполный блок - последний в файле
+            end_of_file = useful < static_cast<ptrdiff_t>(block_size);
+        }
+    }
+
+    view->spans = pinned->spans.data();
+    view->span_count = pinned->spans.size();
+    view->size = static_cast<size_t>(position - offset);
+    view->handle = pinned.release();
+    return 0;
+}
+
+// Освобождение представления: блоки снова можно вытеснять
+void lab2_release_pinned(Lab2PinnedView* view) {
+    if (view == nullptr || view->handle == nullptr) {
+        return;
+    }
+    std::unique_ptr<PinnedView> pinned(static_cast<PinnedView*>(view->handle));
+    unpin_blocks(*pinned->file_desc, pinned->blocks);
+    pinned->file_desc->pinned_views--;
+    *view = {};
+}
+
+// Отображение диапазона файла в память. Ленивая подкачка страниц потребовала бы userfaultfd (он обычно
+// закрыт для непривилегированных процессов) или обработчика SIGSEGV, поэтому блоки загружаются сразу:
+// промахи и попадания проходят через политику замещения и статистику, как у lab2_read_pinned.
+// Буферы закреплённых блоков показываются в окне по порядку, страницы за концом файла остаются недоступными
+void* lab2_map(const HANDLE fd, const int64_t offset, const size_t length, const Lab2MapAccess access) {
+    if (offset < 0 || length == 0) {
+        io_set_invalid_parameter();
+        return nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> pool_guard(frame_pool_lock);
+        if (!frames_shareable) {
+            std::cerr << "Cache frames are not mappable (lab2_map)\n";
+            io_set_invalid_parameter();
+            return nullptr;
+        }
+    }
+    const FileRef file_desc = get_file_descriptor(fd, true);
+    if (file_desc == nullptr) {
+        io_set_invalid_parameter();
+        return nullptr;
+    }
+
+    const int64_t first_block = offset / static_cast<int64_t>(block_size);
+    const int64_t last_block = (offset + static_cast<int64_t>(length) - 1) / static_cast<int64_t>(block_size);
+    FileMapping mapping;
+    mapping.file_desc = file_desc.file;
+    mapping.writable = access == LAB2_MAP_WRITE;
+    mapping.window_size = static_cast<size_t>(last_block - first_block + 1) * block_size;
+    mapping.window = static_cast<char*>(io_reserve_window(mapping.window_size));
+    if (mapping.window == nullptr) {
+        std::cerr << "Can't reserve address space (lab2_map). Error code: " << io_last_error() << std::endl;
+        file_desc->pinned_views--;
+        return nullptr;
+    }
+
+    bool end_of_file = false;
+    bool failed = false;
+    for (int64_t batch_first = first_block; batch_first <= last_block && !end_of_file && !failed;
+         batch_first += READ_BATCH_MAX_BLOCKS) {
+        const int64_t batch_last = std::min<int64_t>(last_block, batch_first + READ_BATCH_MAX_BLOCKS - 1);
+        bool loaded_here[READ_BATCH_MAX_BLOCKS] = {};
+        load_missing_blocks(*file_desc, batch_first, batch_last, loaded_here);
+
+        for (int64_t block_id = batch_first; block_id <= batch_last; ++block_id) {
+            CacheShard& shard = shard_for({file_desc->id, block_id});
+            std::unique_lock<std::mutex> shard_guard(shard.lock);
+            CacheBlock* block = get_cache_block(shard, shard_guard, *file_desc, block_id,
+                                                loaded_here[block_id - batch_first], &end_of_file);
+            if (block == nullptr) {
+                failed = !end_of_file;
                 break;
             }
+            block->pins++;
+            if (mapping.writable) {
+                // Попадания без замков, уже читающие блок, не пройдут проверку seq, новые увидят счётчик
+                block_write_begin(block);
+                block->writable_maps.fetch_add(1, std::memory_order_relaxed);
+                block_write_end(block);
+            }
+            mapping.blocks.push_back(block);
+            // За концом файла в последнем блоке - нули, как на последней странице отображённого файла
+            const ptrdiff_t useful = block->useful_data.load(std::memory_order_relaxed);
+            if (useful < static_cast<ptrdiff_t>(block_size)) {
+                memset(block->data + useful, 0, block_size - useful);
+                end_of_file = true;
+            }
+            shard_guard.unlock();
 
-            // Записываем данные из только что созданного кэшблока
-            bytes_from_block = static_cast<size_t>(std::min<size_t>(available_bytes, iteration_read));
-            memcpy(buffer + bytes_read, aligned_buf + block_offset, bytes_from_block);
+            if (io_map_alias(mapping.window + static_cast<size_t>(block_id - first_block) * block_size,
+                             block->data, block_size, mapping.writable) != 0) {
+                std::cerr << "Can't map cache block (lab2_map). Error code: " << io_last_error() << std::endl;
+                failed = true;
+                break;
+            }
+            if (end_of_file) {
+                break;
+            }
         }
+    }
 
-        // Фиксируем результаты итерации
-        file_desc.offset += bytes_from_block;
-        bytes_read += bytes_from_block;
+    if (failed) {
+        io_release_window(mapping.window, mapping.window_size);
+        unpin_blocks(*file_desc, mapping.blocks, mapping.writable);
+        file_desc->pinned_views--;
+        return nullptr;
     }
+    char* address = mapping.window + static_cast<size_t>(offset % static_cast<int64_t>(block_size));
+    std::lock_guard<std::mutex> mappings_guard(mappings_lock);
+    mappings.emplace(address, std::move(mapping));
+    return address;
+}
 
-    return bytes_read;
+// Запись изменений отображения на диск (вместе с остальными "грязными" блоками файла)
+int lab2_msync(void* address) {
+    FileDescriptor* file_desc;
+    {
+        std::lock_guard<std::mutex> mappings_guard(mappings_lock);
+        const auto it = mappings.find(address);
+        if (it == mappings.end()) {
+            io_set_invalid_parameter();
+            return -1;
+        }
+        file_desc = it->second.file_desc;
+    }
+    return sync_file(*file_desc);
 }
 
-//Запись в файл
-ptrdiff_t lab2_write(const HANDLE fd, const void* buf, const size_t count) {
-    // Получаем файловый дескриптор и смещение
-    FileDescriptor& file_desc = get_file_descriptor(fd);
-    if (file_desc.fd == INVALID_HANDLE_VALUE || file_desc.offset < 0 || !buf) {
-        SetLastError(ERROR_INVALID_PARAMETER); // Устанавливаем ошибку "Invalid parameter"
+// Снятие отображения: изменения остаются в кэше "грязными" блоками, блоки снова можно вытеснять
+int lab2_unmap(void* address) {
+    std::map<void*, FileMapping>::node_type entry;
+    {
+        std::lock_guard<std::mutex> mappings_guard(mappings_lock);
+        entry = mappings.extract(address);
+    }
+    if (entry.empty()) {
+        io_set_invalid_parameter();
         return -1;
     }
+    FileMapping& mapping = entry.mapped();
+    mark_mapping_dirty(mapping);
+    io_release_window(mapping.window, mapping.window_size);
+    unpin_blocks(*mapping.file_desc, mapping.blocks, mapping.writable);
+    mapping.file_desc->pinned_views--;
+    return 0;
+}
+
+// Файл вырос: размер только увеличивается, даже если параллельно идут позиционные записи
+void grow_file_size(FileDescriptor& file_desc, int64_t end) {
+    int64_t size = file_desc.size.load(std::memory_order_relaxed);
+    while (size < end && !file_desc.size.compare_exchange_weak(size, end, std::memory_order_relaxed)) {
+    }
+}
 
+// Запись [position; position + count) в кэш. Возвращает число записанных байт, -1 - ошибка
+ptrdiff_t write_range(FileDescriptor& file_desc, int64_t position, const char* buffer, size_t count) {
     ptrdiff_t bytes_written = 0;
-    const auto buffer = static_cast<const char*>(buf);
+    const bool was_over_background = dirty_over_background();
+    const int64_t old_size = file_desc.size.load(std::memory_order_relaxed);
+    if (count != 0 && position / static_cast<int64_t>(block_size) > old_size / static_cast<int64_t>(block_size)) {
+        pad_tail_block(file_desc, old_size);
+    }
 
-    while (bytes_written < count) {
+    while (bytes_written < static_cast<ptrdiff_t>(count)) {
         // Получаем id блока, в который будем писать
-        LARGE_INTEGER block_id;
-        block_id.QuadPart = file_desc.offset / BLOCK_SIZE;
+        const int64_t block_id = position / block_size;
 
         // Отступ внутри кэшблока
-        const size_t block_offset = file_desc.offset % BLOCK_SIZE;
+        const size_t block_offset = position % block_size;
 
         // Сколько байт запишем на данной итерации
-        // const int iteration_write = static_cast<int>(std::min(BLOCK_SIZE - block_offset, count - bytes_written));
+        // const int iteration_write = static_cast<int>(std::min(block_size - block_offset, count - bytes_written));
         const int iteration_write = static_cast<int>(std::min<ptrdiff_t>(
-                    static_cast<ptrdiff_t>(BLOCK_SIZE - block_offset),
+                    static_cast<ptrdiff_t>(block_size - block_offset),
                     static_cast<ptrdiff_t>(static_cast<ptrdiff_t>(count) - bytes_written)
                 ));
+        const size_t write_end = block_offset + iteration_write;
+        const int64_t block_start = block_id * static_cast<int64_t>(block_size);
+        const int64_t file_size = file_desc.size.load(std::memory_order_relaxed);
+
         // Смотрим, есть ли блок в кэше
-        CacheKey key = {fd, block_id};
-        auto cache_iterator = cache_table.find(key);
-        CacheBlock* block_ptr;
+        CacheKey key = {file_desc.id, block_id};
+        CacheShard& shard = shard_for(key);
+        std::unique_lock<std::mutex> shard_guard(shard.lock);
+        CacheBlock* block_ptr = shard.table.find(key);
+        record_access(shard, key);
+        // Блок читается с диска или пишется на него - ждём, чтобы не менять данные посреди записи
+        while (block_ptr != nullptr && (block_ptr->loading || block_ptr->writeback)) {
+            shard.io_done.wait(shard_guard);
+            block_ptr = shard.table.find(key);
+        }
 
-        if (cache_iterator == cache_table.end()) {
+        if (block_ptr == nullptr) {
             // Не попали в кэшблоки
-            cache_stats.cache_misses++;
-
             // Освобождаем место, если закончилось
-            if (cache_table.size() >= MAX_BLOCKS_IN_CACHE) {
-                free_cache_block(fd);
+            if (!reserve_cache_slot(shard, file_desc, block_id)) {
+                // Шард занят блоками, которые ещё загружаются или пишутся, - дожидаемся их и ищем блок заново
+                if (shard.loading_blocks > 0 || shard.writeback_blocks > 0) {
+                    shard.io_done.wait(shard_guard);
+                    continue;
+                }
+                return -1; // Кэш заполнен блоками, которые не удаётся записать
             }
+            shard.stats.cache_misses++;
 
-            // Создаём кэшблок, записываем в него данные из файла
-            char* aligned_buf = allocate_aligned_buffer();
-            if (!aligned_buf) {
+            // Берём свободный кадр из пула. Блок с диска не читаем: целый блок перезаписывается полностью,
+            // за концом файла читать нечего, а при частичной записи чтение откладывается до обращения
+            // к остальным байтам блока
+            block_ptr = acquire_block_frame();
+            if (!block_ptr) {
                 return -1; // Ошибка выделения памяти
             }
-
-            // Читаем данные из файла
-            LARGE_INTEGER read_offset;
-            read_offset.QuadPart = block_id.QuadPart * BLOCK_SIZE;
-
-            DWORD bytesRead;
-            if (!ReadFile(fd, aligned_buf, BLOCK_SIZE, &bytesRead, nullptr) || bytesRead == 0) {
-                free(aligned_buf);
-                break; // Ошибка чтения или конец файла
+            if (block_start < file_size && (block_offset != 0 || write_end != block_size)) {
+                block_ptr->partial.store(true, std::memory_order_relaxed);
+                block_ptr->valid_begin = block_ptr->valid_end = block_offset;
             }
 
-            // Создаём блок, записываем в него, сколько данных мы прочли
-            CacheBlock new_block = {aligned_buf, false, static_cast<ptrdiff_t>(bytesRead), GetTickCount64()};
-            cache_table[key] = new_block;
-            block_ptr = &cache_table[key];
+            block_ptr->block_id.store(block_id, std::memory_order_relaxed);
+            cache_link_block(shard, file_desc, block_ptr);
+            block_write_end(block_ptr);
         } else {
             // Попали в кэшблоки
-            cache_stats.cache_hits++;
-            block_ptr = &cache_iterator->second;
+            shard.stats.cache_hits++;
+            if (!count_readahead_use(shard, block_ptr)) {
+                policy_touch(shard, block_ptr);
+            }
+            // Достоверный диапазон частичного блока должен остаться непрерывным:
+            // запись с разрывом сначала дочитывает блок с диска
+            if (block_ptr->partial && (write_end < block_ptr->valid_begin || block_offset > block_ptr->valid_end)
+                && !fill_partial_block(*block_ptr, file_desc)) {
+                break;
+            }
         }
 
-        // Записываем в кэшблок, теперь он содержит грязные данные
+        // Записываем в кэшблок, теперь он содержит грязные данные.
+        // Читатели без замков на это время видят нечётный seq
+        block_write_begin(block_ptr);
         memcpy(block_ptr->data + block_offset, buffer + bytes_written, iteration_write);
-        block_ptr->dirty_data = true;
-        // Обновляем время последнего использования
-        block_ptr->last_used = GetTickCount64();
+        mark_block_dirty(block_ptr);
+        const ptrdiff_t useful = block_ptr->useful_data.load(std::memory_order_relaxed);
+        if (block_ptr->partial) {
+            block_ptr->valid_begin = std::min(block_ptr->valid_begin, block_offset);
+            block_ptr->valid_end = std::max(block_ptr->valid_end, write_end);
+            // Диапазон покрыл блок до его конца или до конца файла - дочитывать больше нечего
+            if (block_ptr->valid_begin == 0
+                && (block_ptr->valid_end == block_size || block_start + static_cast<int64_t>(block_ptr->valid_end) >= file_size)) {
+                block_ptr->partial.store(false, std::memory_order_relaxed);
+            }
+        } else if (static_cast<ptrdiff_t>(block_offset) > useful) {
+            // Запись за концом данных блока: разрыв заполняется нулями, как дыра в файле
+            memset(block_ptr->data + useful, 0, block_offset - useful);
+        }
         // Обновляем useful_data - мы могли записать чуть больше, чем было записано в блок раньше
-        block_ptr->useful_data = static_cast<ptrdiff_t>(std::max<ptrdiff_t>(
-            block_ptr->useful_data,
-            static_cast<ptrdiff_t>(block_offset + iteration_write)));
+        block_ptr->useful_data.store(std::max<ptrdiff_t>(useful, static_cast<ptrdiff_t>(write_end)),
+                                     std::memory_order_relaxed);
+        block_write_end(block_ptr);
 
         // Фиксируем результаты итерации
-        file_desc.offset += iteration_write;
+        position += iteration_write;
         bytes_written += iteration_write;
+        grow_file_size(file_desc, position);
+    }
+
+    // Доля "грязных" блоков перешла порог - будим фоновую запись, не дожидаясь её периода
+    if (!was_over_background && dirty_over_background()) {
+        wake_writeback_daemon();
+    }
+    trim_file_to_quota(file_desc);
+    return bytes_written;
+}
+
+//Запись в файл с текущего смещения
+ptrdiff_t lab2_write(const HANDLE fd, const void* buf, const size_t count) {
+    // Получаем открытие файла и смещение
+    const FileRef file_ref = get_open_file(fd);
+    OpenFile* open_file = file_ref.open_file.get();
+    if (open_file == nullptr || !buf) {
+        io_set_invalid_parameter(); // Устанавливаем ошибку "Invalid parameter"
+        return -1;
+    }
+    std::lock_guard<std::mutex> pos_guard(open_file->pos_lock);
+    if (open_file->offset < 0) {
+        io_set_invalid_parameter();
+        return -1;
     }
 
+    const ptrdiff_t bytes_written = write_range(*open_file->file, open_file->offset,
+                                                static_cast<const char*>(buf), count);
+    if (bytes_written > 0) {
+        open_file->offset += bytes_written;
+    }
     return bytes_written;
 }
 
+// Позиционная запись: смещение файла не меняется
+ptrdiff_t lab2_pwrite(const HANDLE fd, const void* buf, const size_t count, const int64_t offset) {
+    const FileRef file_desc = get_file_descriptor(fd);
+    if (file_desc == nullptr || !buf || offset < 0) {
+        io_set_invalid_parameter();
+        return -1;
+    }
+    return write_range(*file_desc, offset, static_cast<const char*>(buf), count);
+}
+
+// Векторная позиционная запись: сегменты ложатся в файл подряд с offset
+ptrdiff_t lab2_pwritev(const HANDLE fd, const Lab2IoVec* iov, const int iovcnt, const int64_t offset) {
+    const FileRef file_desc = get_file_descriptor(fd);
+    if (file_desc == nullptr || (iov == nullptr && iovcnt != 0) || iovcnt < 0 || offset < 0) {
+        io_set_invalid_parameter();
+        return -1;
+    }
+    for (int i = 0; i < iovcnt; ++i) {
+        if (iov[i].base == nullptr && iov[i].length != 0) {
+            io_set_invalid_parameter();
+            return -1;
+        }
+    }
+
+    ptrdiff_t total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        const ptrdiff_t bytes = write_range(*file_desc, offset + total, static_cast<const char*>(iov[i].base),
+                                            iov[i].length);
+        if (bytes < 0) {
+            return total > 0 ? total : -1;
+        }
+        total += bytes;
+        if (bytes < static_cast<ptrdiff_t>(iov[i].length)) {
+            break;
+        }
+    }
+    return total;
+}
+
 // Перестановка позиции указателя
-int lab2_lseek(const HANDLE fd, const int offset, const int whence) {
-    auto& [found_fd, file_offset] = get_file_descriptor(fd);
+int64_t lab2_lseek(const HANDLE fd, const int64_t offset, const int whence) {
+    const FileRef file_ref = get_open_file(fd);
+    OpenFile* open_file = file_ref.open_file.get();
+
+    if (open_file == nullptr) {
+        io_set_invalid_handle();
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> pos_guard(open_file->pos_lock);
+    // Конец файла - логический размер, с блоками, ещё не записанными на диск
+    int64_t base;
+    if (whence == SEEK_SET) {
+        base = 0;
+    } else if (whence == SEEK_CUR) {
+        base = open_file->offset;
+    } else if (whence == SEEK_END) {
+        base = open_file->file->size.load();
+    } else {
+        io_set_invalid_parameter();
+        return -1;
+    }
+    // Итоговое смещение не может быть отрицательным или выйти за int64_t
+    if ((offset > 0 && base > INT64_MAX - offset) || base + offset < 0) {
+        io_set_invalid_parameter();
+        return -1;
+    }
+    open_file->offset = base + offset;
+    return open_file->offset;
+}
+
+// Фоновая загрузка блоков, покрывающих [offset; offset + count)
+int lab2_prefetch(const HANDLE fd, const int64_t offset, const size_t count) {
+    const FileRef file_desc = get_file_descriptor(fd);
+    if (file_desc == nullptr) {
+        io_set_invalid_handle();
+        return -1;
+    }
+    if (offset < 0) {
+        io_set_invalid_parameter();
+        return -1;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    const int64_t first_block = offset / static_cast<int64_t>(block_size);
+    const int64_t last_block = (offset + static_cast<int64_t>(count) - 1) / static_cast<int64_t>(block_size);
+    // Больше половины кэша загружать бессмысленно - загруженное вытеснит само себя
+    const size_t blocks = std::min<size_t>(last_block - first_block + 1, std::max<size_t>(1, max_blocks_in_cache / 2));
+    prefetch_enqueue(*file_desc, first_block, blocks, false);
+    return 0;
+}
+
+// Выгрузка блоков файла из диапазона: "грязные" записываются на диск
+void drop_file_range(FileDescriptor& file_desc, int64_t first_block, int64_t last_block) {
+    std::vector<int64_t> block_ids;
+    {
+        std::lock_guard<std::mutex> blocks_guard(file_desc.blocks_lock);
+        for (CacheBlock* block = file_desc.blocks.head; block != nullptr; block = block->file_links.next) {
+            const int64_t block_id = block->block_id.load(std::memory_order_relaxed);
+            if (block_id >= first_block && block_id <= last_block) {
+                block_ids.push_back(block_id);
+            }
+        }
+    }
 
-    if (found_fd == INVALID_HANDLE_VALUE || file_offset < 0) {
-        SetLastError(ERROR_INVALID_HANDLE);
-        int error_offset;
-        error_offset = -1;
-        return error_offset;
+    for (const int64_t block_id : block_ids) {
+        const CacheKey key = {file_desc.id, block_id};
+        CacheShard& shard = shard_for(key);
+        std::lock_guard<std::mutex> shard_guard(shard.lock);
+        CacheBlock* block = shard.table.find(key);
+        // Сброшенный по подсказке блок не должен выглядеть для 2Q и ARC как вытесненный слишком рано
+        if (block != nullptr) {
+            evict_cache_block(shard, block, false);
+        }
     }
+}
 
-    if (whence != SEEK_SET || offset < 0) {
-        SetLastError(ERROR_INVALID_PARAMETER);
-        int error_offset;
-        error_offset = -1;
-        return error_offset;
+// Подсказка о характере доступа к диапазону файла (как posix_fadvise). len == 0 - до конца файла
+int lab2_fadvise(const HANDLE fd, const int64_t offset, const int64_t len, const Lab2Advice advice) {
+    const FileRef file_desc = get_file_descriptor(fd);
+    if (file_desc == nullptr) {
+        io_set_invalid_handle();
+        return -1;
+    }
+    if (offset < 0 || len < 0) {
+        io_set_invalid_parameter();
+        return -1;
     }
 
-    file_offset = offset;
-    return file_offset;
+    switch (advice) {
+        case LAB2_ADV_NORMAL:
+        case LAB2_ADV_SEQUENTIAL:
+        case LAB2_ADV_RANDOM: {
+            std::lock_guard<std::mutex> ra_guard(file_desc->ra_lock);
+            file_desc->advice = advice;
+            file_desc->ra_window = 0;
+            return 0;
+        }
+        case LAB2_ADV_WILLNEED:
+            // Размер файла неизвестен - "до конца" ограничивается lab2_prefetch половиной кэша
+            return lab2_prefetch(fd, offset, len != 0 ? static_cast<size_t>(len) : max_blocks_in_cache * block_size);
+        case LAB2_ADV_DONTNEED:
+            drop_file_range(*file_desc, offset / static_cast<int64_t>(block_size),
+                            len != 0 ? (offset + len - 1) / static_cast<int64_t>(block_size) : INT64_MAX);
+            return 0;
+    }
+    io_set_invalid_parameter();
+    return -1;
 }
 
+// Статистика собирается по всем шардам
 int get_cache_miss() {
-    return cache_stats.cache_misses;
+    size_t misses = 0;
+    for (CacheShard& shard : cache_shards) {
+        misses += shard.stats.cache_misses.load(std::memory_order_relaxed);
+    }
+    return static_cast<int>(misses);
 }
 int get_cache_hit() {
-    return cache_stats.cache_hits;
+    size_t hits = 0;
+    for (CacheShard& shard : cache_shards) {
+        hits += shard.stats.cache_hits.load(std::memory_order_relaxed);
+    }
+    return static_cast<int>(hits);
+}
+
+// Упреждающее чтение: сколько загруженных им блоков пригодилось и сколько ушло впустую
+int get_readahead_hit() {
+    size_t hits = 0;
+    for (CacheShard& shard : cache_shards) {
+        hits += shard.stats.readahead_hits.load(std::memory_order_relaxed);
+    }
+    return static_cast<int>(hits);
+}
+int get_readahead_waste() {
+    size_t waste = 0;
+    for (CacheShard& shard : cache_shards) {
+        waste += shard.stats.readahead_waste.load(std::memory_order_relaxed);
+    }
+    return static_cast<int>(waste);
+}
+
+// Вытеснения, которые ждали записи "грязного" блока
+int get_dirty_evictions() {
+    size_t evictions = 0;
+    for (CacheShard& shard : cache_shards) {
+        evictions += shard.stats.dirty_evictions.load(std::memory_order_relaxed);
+    }
+    return static_cast<int>(evictions);
+}
+
+int get_admission_rejects() {
+    size_t rejects = 0;
+    for (CacheShard& shard : cache_shards) {
+        rejects += shard.stats.admission_rejects.load(std::memory_order_relaxed);
+    }
+    return static_cast<int>(rejects);
+}
+
+// Байты, прочитанные мимо кэша (могут превышать 2 ГиБ)
+int64_t get_bypassed_bytes() {
+    return bypassed_bytes.load(std::memory_order_relaxed);
+}
+
+// Блоки в кэше: всего и у файла, открытого как fd (-1 - неверный дескриптор)
+int get_cached_blocks() {
+    size_t blocks = 0;
+    for (CacheShard& shard : cache_shards) {
+        std::lock_guard<std::mutex> shard_guard(shard.lock);
+        blocks += shard.table.size();
+    }
+    return static_cast<int>(blocks);
+}
+
+int get_file_cached_blocks(HANDLE fd) {
+    const FileRef file_desc = get_file_descriptor(fd);
+    if (file_desc == nullptr) {
+        io_set_invalid_handle();
+        return -1;
+    }
+    return static_cast<int>(file_desc->cached_blocks.load(std::memory_order_relaxed));
 }
 
 void reset_cache_stats() {
-    cache_stats = {0, 0};
+    for (CacheShard& shard : cache_shards) {
+        shard.stats.cache_hits.store(0, std::memory_order_relaxed);
+        shard.stats.cache_misses.store(0, std::memory_order_relaxed);
+        shard.stats.readahead_hits.store(0, std::memory_order_relaxed);
+        shard.stats.readahead_waste.store(0, std::memory_order_relaxed);
+        shard.stats.dirty_evictions.store(0, std::memory_order_relaxed);
+        shard.stats.admission_rejects.store(0, std::memory_order_relaxed);
+    }
+    bypassed_bytes.store(0, std::memory_order_relaxed);
 }
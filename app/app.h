@@ -3,18 +3,137 @@
 #include <iostream>
 #include <random>
 #include <map>
+#include <cstddef>
+#include <cstdint>
+#ifdef _WIN32
 #include <windows.h>
+#else
+// На POSIX файл идентифицируется целочисленным дескриптором
+typedef int HANDLE;
+#define INVALID_HANDLE_VALUE (-1)
+#endif
 
 extern int get_cache_miss();
 extern int get_cache_hit();
+extern int get_readahead_hit();
+extern int get_readahead_waste();
+extern int get_dirty_evictions();
+extern int get_admission_rejects();
+extern int64_t get_bypassed_bytes();
+extern int get_cached_blocks();
+extern int get_file_cached_blocks(HANDLE fd);
 extern void reset_cache_stats();
 extern void free_all_cache_blocks();
+
+// Политика замещения: в каком порядке блоки шарда становятся кандидатами на вытеснение
+enum Lab2ReplacementPolicy {
+    LAB2_REPLACE_LRU, // Давно не использованные блоки (со вторым шансом для попаданий без замков)
+    LAB2_REPLACE_2Q,  // Новые блоки проходят очередь FIFO; в основной список - только повторно запрошенные
+    LAB2_REPLACE_ARC, // Списки недавних и частых блоков, граница между ними подстраивается по призрачным спискам
+    LAB2_REPLACE_CLOCK, // Второй шанс по признаку обращения: попадание ничего не переставляет, стрелка обходит кольцо блоков
+};
+
+// Параметры кэша
+struct Lab2CacheConfig {
+    size_t capacity_bytes; // Объём кэша в байтах
+    size_t block_size;     // Размер блока: степень двойки от 4 КиБ до 1 МиБ
+    Lab2ReplacementPolicy replacement; // Политика замещения (по умолчанию LRU)
+    bool admission_filter; // Фильтр допуска TinyLFU: промах вытесняет блок, только если он нужен чаще жертвы
+    bool mappable;         // Буферы блоков на разделяемой памяти (без больших страниц): доступен lab2_map.
+                           // Блок должен быть кратен выравниванию отображений: странице, на Windows - 64 КиБ
+};
+extern int lab2_cache_init(const Lab2CacheConfig* config);
+extern int lab2_cache_resize(size_t capacity_bytes);
+
+// Политика вытеснения блоков
+enum Lab2EvictionPolicy {
+    LAB2_EVICT_GLOBAL,          // Вытесняется самый старый блок среди всех открытых файлов
+    LAB2_EVICT_PER_FILE_QUOTA,  // Равная доля кэша на открытие; файл сверх доли своих открытий вытесняет свои блоки
+};
+extern void set_eviction_policy(Lab2EvictionPolicy policy);
+extern void set_replacement_policy(Lab2ReplacementPolicy policy);
+// Блоки, не допущенные фильтром, читаются мимо кэша
+extern void set_admission_filter(bool enabled);
+// Чтения не меньше threshold_bytes, начинающиеся на границе блока в буфер, выровненный по 4 КиБ,
+// идут с диска прямо в буфер и не вытесняют кэш (блоки, которые уже в кэше, берутся из него). 0 - выключено
+extern void set_read_bypass(size_t threshold_bytes);
+// Сколько последних закрытых файлов хранят свои блоки (0 - блоки удаляются при закрытии).
+// Повторное открытие берёт их, если размер и время изменения файла с закрытия не поменялись
+extern void set_closed_file_retention(size_t files);
+
+// Фоновая запись "грязных" блоков (как vm.dirty_background_ratio и vm.dirty_expire_centisecs)
+struct Lab2WritebackConfig {
+    unsigned dirty_background_ratio; // Доля "грязных" блоков в процентах от ёмкости, после которой запись начинается сразу
+    unsigned dirty_expire_ms;        // Возраст "грязного" блока, после которого он записывается; 0 - без ограничения
+    size_t max_write_bytes;          // Предел одной записи, в которую объединяются соседние "грязные" блоки
+};
+extern int lab2_set_writeback(const Lab2WritebackConfig* config);
+
+// Подсказки о характере доступа к файлу (как posix_fadvise)
+enum Lab2Advice {
+    LAB2_ADV_NORMAL,     // Обычное упреждающее чтение
+    LAB2_ADV_SEQUENTIAL, // Последовательный доступ: окно упреждающего чтения сразу максимальное
+    LAB2_ADV_RANDOM,     // Случайный доступ: упреждающее чтение выключено
+    LAB2_ADV_WILLNEED,   // Диапазон скоро понадобится: загрузить в фоне
+    LAB2_ADV_DONTNEED,   // Диапазон больше не нужен: записать на диск и убрать из кэша
+};
 extern int get_rand_from_to(int min, int max);
 extern int lab2_close(HANDLE fd);
 extern HANDLE lab2_open(const char* path);
 extern ptrdiff_t lab2_read(HANDLE fd, void *buf, size_t count);
 extern ptrdiff_t lab2_write(HANDLE fd, const void *buf, size_t count);
-extern int lab2_lseek(HANDLE fd, int offset, int whence);
+// whence: SEEK_SET, SEEK_CUR или SEEK_END; возвращает новое смещение, -1 - ошибка
+extern int64_t lab2_lseek(HANDLE fd, int64_t offset, int whence);
 extern int lab2_fsync(HANDLE fd);
 
+// Позиционный ввод-вывод (как pread/pwrite): смещение файла не меняется и не блокируется,
+// поэтому один дескриптор можно делить между потоками
+extern ptrdiff_t lab2_pread(HANDLE fd, void* buf, size_t count, int64_t offset);
+extern ptrdiff_t lab2_pwrite(HANDLE fd, const void* buf, size_t count, int64_t offset);
+// Сегмент векторного ввода-вывода (как struct iovec)
+struct Lab2IoVec {
+    void* base;
+    size_t length;
+};
+// Сегменты читаются и пишутся подряд начиная с offset; промахи всех сегментов загружаются общими пакетами
+extern ptrdiff_t lab2_preadv(HANDLE fd, const Lab2IoVec* iov, int iovcnt, int64_t offset);
+extern ptrdiff_t lab2_pwritev(HANDLE fd, const Lab2IoVec* iov, int iovcnt, int64_t offset);
+// Фоновая загрузка диапазона файла в кэш
+extern int lab2_prefetch(HANDLE fd, int64_t offset, size_t count);
+extern int lab2_fadvise(HANDLE fd, int64_t offset, int64_t len, Lab2Advice advice);
+
+// Чтение без копирования: вызывающий получает указатели прямо на блоки кэша.
+// Блоки закреплены и не вытесняются, пока представление не освобождено; запись в файл
+// меняет закреплённые данные на месте (как у отображения файла в память).
+// Закреплённые блоки занимают ёмкость кэша: чтение и запись в часть кэша, где закреплено всё,
+// завершаются ошибкой. Файл с неосвобождёнными представлениями не закрывается
+struct Lab2Span {
+    const char* data; // Данные внутри блока кэша
+    size_t size;      // Длина куска
+};
+struct Lab2PinnedView {
+    const Lab2Span* spans; // Куски по блокам, по возрастанию смещения
+    size_t span_count;
+    size_t size;           // Всего байт (меньше запрошенного, если файл кончился)
+    void* handle;          // Для lab2_release_pinned
+};
+// Позиционное чтение: смещение файла не меняется. 0 - успех, -1 - ошибка
+extern int lab2_read_pinned(HANDLE fd, int64_t offset, size_t count, Lab2PinnedView* view);
+extern void lab2_release_pinned(Lab2PinnedView* view);
+
+// Отображение диапазона файла в память поверх кэша (нужен кэш с mappable): блоки диапазона загружаются
+// и закрепляются сразу, их буферы видны подряд в одном окне адресов. Запись через окно с LAB2_MAP_WRITE
+// меняет блоки кэша; "грязными" они становятся при lab2_msync, lab2_fsync и lab2_unmap.
+// Запись через окно не упорядочена с lab2_read и lab2_write тех же байт (как запись в отображение
+// и read/write в POSIX): пока окно на запись открыто, вызывающий сам не пересекает их по времени.
+// Страницы окна за концом файла недоступны. Файл с отображениями не закрывается
+enum Lab2MapAccess {
+    LAB2_MAP_READ,
+    LAB2_MAP_WRITE,
+};
+// Адрес байта offset в окне, nullptr - ошибка
+extern void* lab2_map(HANDLE fd, int64_t offset, size_t length, Lab2MapAccess access);
+extern int lab2_msync(void* address);
+extern int lab2_unmap(void* address);
+
 #endif //APP_H
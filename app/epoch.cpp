@@ -0,0 +1,127 @@
+#include "epoch.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// Сколько потоков одновременно могут читать без замков
+#define EPOCH_MAX_THREADS 256
+
+// Глобальная эпоха начинается с 1: 0 в слоте означает "поток вне критической секции"
+std::atomic<uint64_t> global_epoch {1};
+
+// Слот потока: эпоха, в которой поток вошёл в критическую секцию
+struct EpochSlot {
+    alignas(64) std::atomic<uint64_t> local_epoch {0};
+    std::atomic<bool> in_use {false};
+};
+EpochSlot epoch_slots[EPOCH_MAX_THREADS];
+// Сколько слотов от начала массива когда-либо занималось (сдвиг эпохи смотрит только их)
+std::atomic<size_t> epoch_slots_used {0};
+
+// Регистрация потока: слот занимается при первом входе и освобождается при завершении потока
+struct EpochThreadRecord {
+    EpochSlot* slot = nullptr;
+
+    EpochSlot* get() {
+        if (slot != nullptr) {
+            return slot;
+        }
+        for (size_t i = 0; i < EPOCH_MAX_THREADS; ++i) {
+            bool expected = false;
+            if (epoch_slots[i].in_use.compare_exchange_strong(expected, true)) {
+                slot = &epoch_slots[i];
+                size_t used = epoch_slots_used.load();
+                while (used < i + 1 && !epoch_slots_used.compare_exchange_weak(used, i + 1)) {
+                }
+                break;
+            }
+        }
+        return slot;
+    }
+
+    ~EpochThreadRecord() {
+        if (slot != nullptr) {
+            slot->local_epoch.store(0, std::memory_order_release);
+            slot->in_use.store(false, std::memory_order_release);
+        }
+    }
+};
+thread_local EpochThreadRecord epoch_thread;
+
+// Отложенные объекты
+struct RetiredObject {
+    uint64_t epoch;
+    void* ptr;
+    void (*deleter)(void*);
+};
+// При завершении программы читателей уже нет - оставшиеся объекты освобождаются сразу
+struct RetiredList : std::vector<RetiredObject> {
+    ~RetiredList() {
+        for (const RetiredObject& object : *this) {
+            object.deleter(object.ptr);
+        }
+    }
+};
+std::mutex retired_lock;
+RetiredList retired_objects;
+
+bool epoch_enter() {
+    EpochSlot* slot = epoch_thread.get();
+    if (slot == nullptr) {
+        return false;
+    }
+    slot->local_epoch.store(global_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    // Объявление эпохи должно стать видимым раньше любых чтений в критической секции
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return true;
+}
+
+void epoch_exit() {
+    epoch_thread.slot->local_epoch.store(0, std::memory_order_release);
+}
+
+uint64_t epoch_current() {
+    return global_epoch.load(std::memory_order_acquire);
+}
+
+void epoch_try_advance() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t epoch = global_epoch.load(std::memory_order_acquire);
+    const size_t used = epoch_slots_used.load(std::memory_order_acquire);
+    for (size_t i = 0; i < used; ++i) {
+        const uint64_t local = epoch_slots[i].local_epoch.load(std::memory_order_acquire);
+        if (local != 0 && local != epoch) {
+            return; // Кто-то ещё читает в прошлой эпохе
+        }
+    }
+    global_epoch.compare_exchange_strong(epoch, epoch + 1);
+}
+
+bool epoch_is_safe(uint64_t retired_epoch) {
+    return epoch_current() >= retired_epoch + 2;
+}
+
+void epoch_retire(void* ptr, void (*deleter)(void*)) {
+    std::lock_guard<std::mutex> guard(retired_lock);
+    retired_objects.push_back({epoch_current(), ptr, deleter});
+}
+
+void epoch_reclaim() {
+    epoch_try_advance();
+    std::vector<RetiredObject> ready;
+    {
+        std::lock_guard<std::mutex> guard(retired_lock);
+        auto it = retired_objects.begin();
+        while (it != retired_objects.end()) {
+            if (epoch_is_safe(it->epoch)) {
+                ready.push_back(*it);
+                it = retired_objects.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (const RetiredObject& object : ready) {
+        object.deleter(object.ptr);
+    }
+}
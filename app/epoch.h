@@ -0,0 +1,27 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+#include <cstdint>
+
+// Эпохи для безопасного освобождения памяти, которую читают без замков.
+// Читатель оборачивает доступ в epoch_enter/epoch_exit; объект, отцепленный от
+// структур данных в эпоху e, можно переиспользовать, когда глобальная эпоха дошла до e + 2:
+// к этому моменту все читатели, которые могли его видеть, вышли из критической секции.
+
+// Вход в критическую секцию читателя. false - поток не удалось зарегистрировать
+// (исчерпаны слоты), тогда читать без замков нельзя
+bool epoch_enter();
+void epoch_exit();
+
+// Текущая глобальная эпоха
+uint64_t epoch_current();
+// Попытка сдвинуть эпоху: удаётся, если все активные читатели уже в текущей эпохе
+void epoch_try_advance();
+// Можно ли переиспользовать объект, отцепленный в эпоху retired_epoch
+bool epoch_is_safe(uint64_t retired_epoch);
+
+// Отложенное освобождение объекта
+void epoch_retire(void* ptr, void (*deleter)(void*));
+// Освобождение отложенных объектов, для которых прошёл период ожидания
+void epoch_reclaim();
+
+#endif //EPOCH_H
@@ -0,0 +1,81 @@
+#ifndef IO_BACKEND_H
+#define IO_BACKEND_H
+#include "app.h"
+
+// Платформенный слой ввода-вывода кэша.
+// Реализация выбирается при сборке: io_backend_win.cpp (Win32)
+// или io_backend_posix.cpp (open с O_DIRECT, pread/pwrite, fdatasync).
+
+// Открытие файла на чтение и запись в обход системного кэша (если ФС это позволяет)
+HANDLE io_open(const char* path);
+// Закрытие файла
+int io_close(HANDLE fd);
+// Позиционное чтение: не трогает указатель файла, 0 - конец файла, -1 - ошибка
+ptrdiff_t io_pread(HANDLE fd, void* buf, size_t count, int64_t offset);
+// Одно чтение в пакете; result заполняется так же, как результат io_pread
+struct IoReadRequest {
+    void* data;
+    size_t size;
+    int64_t offset;
+    ptrdiff_t result;
+};
+// Пакетное чтение: на Linux все запросы уходят в ядро одним io_uring_enter и завершаются параллельно,
+// без io_uring подряд идущие запросы объединяются в одно векторное чтение. Возврат - когда завершены все
+void io_read_batch(HANDLE fd, IoReadRequest* requests, size_t count);
+// Области, которые пакетное чтение может заранее закрепить в ядре (slab-области пула блоков)
+void io_set_fixed_buffers(void* const* regions, const size_t* sizes, size_t count);
+// Позиционная запись: -1 - ошибка, иначе количество записанных байт
+ptrdiff_t io_pwrite(HANDLE fd, const void* buf, size_t count, int64_t offset);
+// Сегмент векторной записи
+struct IoWriteSegment {
+    const void* data;
+    size_t size;
+};
+// Векторная запись: сегменты ложатся в файл подряд начиная с offset (pwritev / одна WriteFile).
+// -1 - ошибка, иначе количество записанных байт
+ptrdiff_t io_pwritev(HANDLE fd, const IoWriteSegment* segments, size_t count, int64_t offset);
+// Размер файла в байтах, -1 - ошибка
+int64_t io_file_size(HANDLE fd);
+// Идентификатор файла: один и тот же у всех открытий файла (устройство и inode / том и индекс файла)
+struct IoFileId {
+    uint64_t device;
+    uint64_t inode;
+
+    bool operator<(const IoFileId& other) const {
+        return device != other.device ? device < other.device : inode < other.inode;
+    }
+};
+// -1 - ошибка
+int io_file_id(HANDLE fd, IoFileId* id);
+// Время последнего изменения данных файла в наносекундах от 1970 года, -1 - ошибка
+int64_t io_file_mtime(HANDLE fd);
+// Сброс данных файла на устройство
+int io_datasync(HANDLE fd);
+
+// Резервирование области под slab буферов блоков: выровнена по странице,
+// по возможности размещается на больших страницах. Страницы разделяемой области (shareable)
+// можно показать ещё по одному адресу, она строится на разделяемой памяти из обычных страниц.
+// nullptr - ошибка
+void* io_reserve_region(size_t size, bool shareable);
+void io_release_region(void* region, size_t size);
+// Окно адресов без доступа, в которое io_map_alias показывает страницы разделяемых областей.
+// nullptr - ошибка
+void* io_reserve_window(size_t size);
+void io_release_window(void* window, size_t size);
+// Показ size байт разделяемой области, начиная с source, по адресу target внутри окна
+// (target, source и size выровнены по io_map_granularity). -1 - ошибка
+int io_map_alias(void* target, const void* source, size_t size, bool writable);
+// Выравнивание, которого io_map_alias требует от адресов и размера: страница на POSIX,
+// гранулярность выделения (обычно 64 КиБ) на Windows
+size_t io_map_granularity();
+
+// Код последней ошибки платформы (GetLastError / errno)
+int io_last_error();
+// Выставление кода ошибки "неверный дескриптор" / "неверный параметр"
+void io_set_invalid_handle();
+void io_set_invalid_parameter();
+
+// Монотонное время в миллисекундах
+unsigned long long io_tick_ms();
+
+#endif //IO_BACKEND_H
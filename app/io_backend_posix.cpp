@@ -0,0 +1,702 @@
+#include "io_backend.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define HAVE_IO_URING 1
+#endif
+
+// Выравнивание смещения и длины, которого требует O_DIRECT
+#define DIRECT_IO_ALIGNMENT 4096
+// Размер большой страницы
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+// Размер очереди кольца io_uring: столько запросов уходит в ядро за один вызов
+#define URING_ENTRIES 128
+
+// Дескрипторы, открытые с O_DIRECT -> обычный дескриптор того же файла. Невыровненные записи
+// (хвост файла, часть блока) O_DIRECT не допускает, они идут через обычный дескриптор,
+// а флаги общего дескриптора, по которому одновременно читают и пишут другие потоки, не меняются
+std::mutex buffered_fds_lock;
+std::unordered_map<int, int> buffered_fds;
+
+// Открытие файла
+HANDLE io_open(const char* path) {
+    int flags = O_RDWR;
+#ifdef O_DIRECT
+    // Читаем и пишем в обход page cache ядра
+    int fd = open(path, flags | O_DIRECT);
+    if (fd >= 0) {
+        const int buffered_fd = open(path, flags);
+        if (buffered_fd < 0) {
+            const int error = errno;
+            close(fd);
+            errno = error;
+            return -1;
+        }
+        std::lock_guard<std::mutex> guard(buffered_fds_lock);
+        buffered_fds[fd] = buffered_fd;
+        return fd;
+    }
+    // Некоторые ФС (tmpfs и т.п.) не поддерживают O_DIRECT - открываем обычным образом
+    if (errno != EINVAL) {
+        return fd;
+    }
+#endif
+    return open(path, flags);
+}
+
+int io_close(HANDLE fd) {
+    int buffered_fd = -1;
+    {
+        std::lock_guard<std::mutex> guard(buffered_fds_lock);
+        const auto it = buffered_fds.find(fd);
+        if (it != buffered_fds.end()) {
+            buffered_fd = it->second;
+            buffered_fds.erase(it);
+        }
+    }
+    if (buffered_fd >= 0) {
+        close(buffered_fd);
+    }
+    return close(fd);
+}
+
+ptrdiff_t io_pread(HANDLE fd, void* buf, size_t count, int64_t offset) {
+    ssize_t bytes_read;
+    do {
+        bytes_read = pread(fd, buf, count, static_cast<off_t>(offset));
+    } while (bytes_read < 0 && errno == EINTR);
+    return bytes_read;
+}
+
+// Подряд идущие запросы (конец одного - начало следующего) читаются одним preadv
+void read_batch_preadv(HANDLE fd, IoReadRequest* requests, size_t count) {
+    iovec iov[IOV_MAX];
+    size_t first = 0;
+    while (first < count) {
+        size_t last = first + 1;
+        while (last < count && last - first < IOV_MAX
+               && requests[last].offset == requests[last - 1].offset + static_cast<int64_t>(requests[last - 1].size)) {
+            last++;
+        }
+        for (size_t i = first; i < last; ++i) {
+            iov[i - first].iov_base = requests[i].data;
+            iov[i - first].iov_len = requests[i].size;
+        }
+
+        ssize_t bytes_read;
+        do {
+            bytes_read = preadv(fd, iov, static_cast<int>(last - first), static_cast<off_t>(requests[first].offset));
+        } while (bytes_read < 0 && errno == EINTR);
+
+        // Прочитанное распределяется по запросам по порядку, за концом файла - нули
+        for (size_t i = first; i < last; ++i) {
+            if (bytes_read < 0) {
+                requests[i].result = -1;
+                continue;
+            }
+            const size_t chunk = std::min<size_t>(requests[i].size, static_cast<size_t>(bytes_read));
+            requests[i].result = static_cast<ptrdiff_t>(chunk);
+            bytes_read -= static_cast<ssize_t>(chunk);
+        }
+        first = last;
+    }
+}
+
+#ifdef HAVE_IO_URING
+// Запрос ещё не завершён (result такого значения не принимает)
+#define URING_PENDING PTRDIFF_MIN
+
+// Пакет одного потока в общем кольце
+struct UringBatch {
+    size_t remaining; // Отправленные, но ещё не завершённые запросы
+    int error;        // Код ошибки неудачного чтения (errno выставляется в потоке пакета)
+};
+// Запрос пакета в полёте: его адрес уходит в user_data
+struct UringSlot {
+    UringBatch* batch;
+    IoReadRequest* request;
+    iovec iov; // Буфер запроса не из закреплённой области
+};
+
+// Кольцо io_uring, одно на процесс: фиксированные буферы регистрируются в нём один раз, а не в каждом потоке,
+// и закреплённая память считается против RLIMIT_MEMLOCK единожды.
+// Очередь отправки и разбор завершений - под lock; ждёт завершений в ядре один поток-сборщик (reaping),
+// он раздаёт завершения по пакетам, остальные ждут на progress. В полёте не больше entries запросов,
+// поэтому очередь завершений не переполняется
+struct IoUring {
+    std::mutex lock;
+    std::condition_variable progress; // Завершились запросы или освободилась роль сборщика
+    int fd = -1;
+    bool unavailable = false; // Ядро без io_uring, он запрещён (seccomp) или кольцо сломано - читаем через preadv
+    bool reaping = false;
+    bool registering = false; // Ждём, пока опустеет кольцо, чтобы сменить фиксированные буферы
+    size_t in_flight = 0;
+    unsigned entries = 0;
+
+    void* sq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+
+    void* cq_ring = nullptr;
+    size_t cq_ring_size = 0;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    // Ячейки запросов в полёте: их не больше entries, поэтому хватает массива на глубину кольца.
+    // Ячейка занята от отправки запроса до разбора его завершения
+    UringSlot slots[URING_ENTRIES];
+    unsigned free_slots[URING_ENTRIES];
+    unsigned free_slot_count = 0;
+
+    std::vector<iovec> fixed_buffers; // Области пула блоков, заданные io_set_fixed_buffers
+    std::vector<iovec> buffers;       // Зарегистрированные в ядре области
+
+    // Вызывается под lock
+    bool setup() {
+        if (fd >= 0) {
+            return true;
+        }
+        if (unavailable) {
+            return false;
+        }
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, URING_ENTRIES, &params));
+        if (fd < 0) {
+            unavailable = true;
+            return false;
+        }
+
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+        }
+        sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        cq_ring = single_mmap ? sq_ring
+                              : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes_area = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes_area == MAP_FAILED) {
+            if (sqes_area != MAP_FAILED) {
+                munmap(sqes_area, sqes_size);
+            }
+            sqes = nullptr;
+            teardown();
+            unavailable = true;
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe*>(sqes_area);
+
+        char* sq = static_cast<char*>(sq_ring);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        char* cq = static_cast<char*>(cq_ring);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        entries = std::min<unsigned>(params.sq_entries, URING_ENTRIES);
+        for (unsigned i = 0; i < entries; ++i) {
+            free_slots[i] = i;
+        }
+        free_slot_count = entries;
+        register_buffers();
+        return true;
+    }
+
+    // Регистрация текущих областей пула вместо прежних (под lock, в полёте ничего нет)
+    void register_buffers() {
+        if (!buffers.empty()) {
+            syscall(__NR_io_uring_register, fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+            buffers.clear();
+        }
+        // Если память закрепить не удалось (например, упёрлись в RLIMIT_MEMLOCK), читаем в обычные буферы
+        if (!fixed_buffers.empty()
+            && syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, fixed_buffers.data(), fixed_buffers.size()) == 0) {
+            buffers = fixed_buffers;
+        }
+    }
+
+    // Номер зарегистрированной области, целиком содержащей буфер, или -1
+    int buffer_index(const void* data, size_t size) const {
+        const char* begin = static_cast<const char*>(data);
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            const char* base = static_cast<const char*>(buffers[i].iov_base);
+            if (begin >= base && begin + size <= base + buffers[i].iov_len) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    // Разбор готовых завершений по пакетам их потоков (под lock)
+    void reap_completions() {
+        unsigned head = *cq_head;
+        const unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            const io_uring_cqe& cqe = cqes[head & *cq_mask];
+            UringSlot* slot = reinterpret_cast<UringSlot*>(static_cast<uintptr_t>(cqe.user_data));
+            if (cqe.res < 0) {
+                slot->request->result = -1;
+                slot->batch->error = -cqe.res;
+            } else {
+                slot->request->result = cqe.res;
+            }
+            slot->batch->remaining--;
+            free_slots[free_slot_count++] = static_cast<unsigned>(slot - slots);
+            in_flight--;
+            head++;
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    // Ожидание условия с участием в сборе завершений: если сборщика нет, поток сам ждёт в ядре.
+    // Кольцо, сломавшееся во время ожидания, тоже завершает ожидание
+    template <typename Predicate>
+    void wait_until(std::unique_lock<std::mutex>& guard, Predicate done) {
+        while (!done() && !unavailable) {
+            if (reaping || in_flight == 0) {
+                progress.wait(guard);
+                continue;
+            }
+            reaping = true;
+            guard.unlock();
+            const long result = syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            const int error = errno;
+            guard.lock();
+            reaping = false;
+            if (result < 0 && error != EINTR && error != EAGAIN && error != EBUSY) {
+                // Завершений больше не будет: ждущие дочитают свои запросы синхронно
+                unavailable = true;
+            }
+            reap_completions();
+            progress.notify_all();
+        }
+    }
+
+    void teardown() {
+        if (sqes) {
+            munmap(sqes, sqes_size);
+        }
+        if (cq_ring && cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+            munmap(cq_ring, cq_ring_size);
+        }
+        if (sq_ring && sq_ring != MAP_FAILED) {
+            munmap(sq_ring, sq_ring_size);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        sqes = nullptr;
+        sq_ring = cq_ring = nullptr;
+        fd = -1;
+    }
+};
+
+// Кольцо не разрушается при выходе: пул упреждающего чтения может читать, пока разрушаются глобальные объекты
+IoUring& shared_ring() {
+    static IoUring* const ring = new IoUring;
+    return *ring;
+}
+
+// Отправка пакета через общее кольцо и ожидание всех его завершений.
+// Возвращает false, если кольцо недоступно - тогда пакет читается через preadv
+bool read_batch_uring(HANDLE fd, IoReadRequest* requests, size_t count) {
+    IoUring& ring = shared_ring();
+    std::unique_lock<std::mutex> guard(ring.lock);
+    if (!ring.setup()) {
+        return false;
+    }
+
+    UringBatch batch {0, 0};
+    for (size_t i = 0; i < count; ++i) {
+        requests[i].result = URING_PENDING;
+    }
+
+    size_t first = 0;
+    while (first < count) {
+        const size_t chunk = std::min<size_t>(ring.entries, count - first);
+        ring.wait_until(guard, [&] { return !ring.registering && ring.in_flight + chunk <= ring.entries; });
+        if (ring.unavailable) {
+            break;
+        }
+        unsigned tail = *ring.sq_tail;
+        for (size_t i = first; i < first + chunk; ++i) {
+            IoReadRequest& request = requests[i];
+            const unsigned index = tail & *ring.sq_mask;
+            io_uring_sqe& sqe = ring.sqes[index];
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.fd = fd;
+            sqe.off = static_cast<uint64_t>(request.offset);
+            // Свободная ячейка есть всегда: запросов в полёте вместе с нашими не больше entries
+            UringSlot& slot = ring.slots[ring.free_slots[--ring.free_slot_count]];
+            slot = {&batch, &request, {request.data, request.size}};
+            sqe.user_data = reinterpret_cast<uintptr_t>(&slot);
+            const int buffer = ring.buffer_index(request.data, request.size);
+            if (buffer >= 0) {
+                // Буфер из закреплённой области: ядру не нужно закреплять страницы на каждый запрос
+                sqe.opcode = IORING_OP_READ_FIXED;
+                sqe.addr = reinterpret_cast<uintptr_t>(request.data);
+                sqe.len = static_cast<uint32_t>(request.size);
+                sqe.buf_index = static_cast<uint16_t>(buffer);
+            } else {
+                sqe.opcode = IORING_OP_READV;
+                sqe.addr = reinterpret_cast<uintptr_t>(&slot.iov);
+                sqe.len = 1;
+            }
+            ring.sq_array[index] = index;
+            tail++;
+        }
+        __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+        ring.in_flight += chunk;
+        batch.remaining += chunk;
+
+        // Отправляем, не отпуская замок: иначе в очередь за нашими запросами встанут чужие
+        unsigned to_submit = static_cast<unsigned>(chunk);
+        while (to_submit > 0) {
+            const long submitted = syscall(__NR_io_uring_enter, ring.fd, to_submit, 0, 0, nullptr, 0);
+            if (submitted > 0) {
+                to_submit -= std::min<unsigned>(to_submit, static_cast<unsigned>(submitted));
+            } else if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                // Кольцо сломано: больше его не используем
+                ring.unavailable = true;
+                ring.progress.notify_all();
+                break;
+            }
+        }
+        first += chunk;
+    }
+    ring.wait_until(guard, [&] { return batch.remaining == 0; });
+    const bool broken = ring.unavailable;
+    guard.unlock();
+
+    for (size_t i = 0; i < count; ++i) {
+        if (requests[i].result == URING_PENDING && broken) {
+            // Запрос не отправлен или завершения уже не придут - дочитываем синхронно
+            requests[i].result = io_pread(fd, requests[i].data, requests[i].size, requests[i].offset);
+        } else if (requests[i].result < 0) {
+            errno = batch.error;
+        }
+    }
+    return true;
+}
+#endif
+
+void io_read_batch(HANDLE fd, IoReadRequest* requests, size_t count) {
+#ifdef HAVE_IO_URING
+    // Одиночное чтение дешевле сделать обычным вызовом
+    if (count > 1 && read_batch_uring(fd, requests, count)) {
+        return;
+    }
+#endif
+    read_batch_preadv(fd, requests, count);
+}
+
+// Новые области регистрируются сразу, прежние снимаются до того, как пул их освободит:
+// смена ждёт, пока завершатся чтения в полёте, новые запросы до её конца не отправляются
+void io_set_fixed_buffers(void* const* regions, const size_t* sizes, size_t count) {
+#ifdef HAVE_IO_URING
+    IoUring& ring = shared_ring();
+    std::unique_lock<std::mutex> guard(ring.lock);
+    ring.fixed_buffers.clear();
+    for (size_t i = 0; i < count; ++i) {
+        ring.fixed_buffers.push_back({regions[i], sizes[i]});
+    }
+    if (ring.fd < 0 || ring.unavailable) {
+        // Кольца ещё нет - области зарегистрирует setup
+        return;
+    }
+    ring.registering = true;
+    ring.wait_until(guard, [&] { return ring.in_flight == 0; });
+    ring.register_buffers();
+    ring.registering = false;
+    ring.progress.notify_all();
+#else
+    (void) regions;
+    (void) sizes;
+    (void) count;
+#endif
+}
+
+// Невыровненную запись (хвост файла, часть блока) O_DIRECT не допускает
+bool needs_buffered_write(const void* buf, size_t count, int64_t offset) {
+    return count % DIRECT_IO_ALIGNMENT != 0 || offset % DIRECT_IO_ALIGNMENT != 0
+           || reinterpret_cast<uintptr_t>(buf) % DIRECT_IO_ALIGNMENT != 0;
+}
+
+// Дескриптор для записи: обычный, если запись невыровнена, а файл открыт с O_DIRECT
+int write_fd(int fd, bool buffered) {
+    if (!buffered) {
+        return fd;
+    }
+    std::lock_guard<std::mutex> guard(buffered_fds_lock);
+    const auto it = buffered_fds.find(fd);
+    return it != buffered_fds.end() ? it->second : fd;
+}
+
+// Запись "хвоста" файла короче блока невозможна при O_DIRECT,
+// поэтому такая запись идёт через обычный дескриптор файла
+ptrdiff_t io_pwrite(HANDLE handle, const void* buf, size_t count, int64_t offset) {
+    const int fd = write_fd(handle, needs_buffered_write(buf, count, offset));
+
+    const auto data = static_cast<const char*>(buf);
+    size_t bytes_written = 0;
+    while (bytes_written < count) {
+        ssize_t result = pwrite(fd, data + bytes_written, count - bytes_written,
+                                static_cast<off_t>(offset + bytes_written));
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            break;
+        }
+        bytes_written += static_cast<size_t>(result);
+    }
+
+    if (bytes_written == 0 && count != 0) {
+        return -1;
+    }
+    return static_cast<ptrdiff_t>(bytes_written);
+}
+
+// Векторная запись: сегменты идут в файл подряд одним pwritev (по IOV_MAX сегментов за вызов)
+ptrdiff_t io_pwritev(HANDLE handle, const IoWriteSegment* segments, size_t count, int64_t offset) {
+    size_t total = 0;
+    bool buffered = false;
+    for (size_t i = 0; i < count; ++i) {
+        buffered = buffered || needs_buffered_write(segments[i].data, segments[i].size, offset);
+        total += segments[i].size;
+    }
+    const int fd = write_fd(handle, buffered);
+
+    iovec iov[IOV_MAX];
+    size_t first = 0;       // Первый не до конца записанный сегмент
+    size_t first_done = 0;  // Сколько байт этого сегмента уже записано
+    size_t bytes_written = 0;
+    while (first < count) {
+        const size_t segments_count = std::min<size_t>(count - first, IOV_MAX);
+        for (size_t i = 0; i < segments_count; ++i) {
+            const size_t skip = i == 0 ? first_done : 0;
+            iov[i].iov_base = const_cast<char*>(static_cast<const char*>(segments[first + i].data)) + skip;
+            iov[i].iov_len = segments[first + i].size - skip;
+        }
+        ssize_t result = pwritev(fd, iov, static_cast<int>(segments_count), static_cast<off_t>(offset + bytes_written));
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            break;
+        }
+        bytes_written += static_cast<size_t>(result);
+        // Частичная запись: пропускаем записанные сегменты
+        size_t left = static_cast<size_t>(result);
+        while (left > 0 && first < count) {
+            const size_t rest = segments[first].size - first_done;
+            if (left < rest) {
+                first_done += left;
+                left = 0;
+            } else {
+                left -= rest;
+                first++;
+                first_done = 0;
+            }
+        }
+        while (first < count && segments[first].size == 0) {
+            first++;
+        }
+    }
+
+    if (bytes_written == 0 && total != 0) {
+        return -1;
+    }
+    return static_cast<ptrdiff_t>(bytes_written);
+}
+
+int64_t io_file_size(HANDLE fd) {
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        return -1;
+    }
+    return static_cast<int64_t>(info.st_size);
+}
+
+int io_file_id(HANDLE fd, IoFileId* id) {
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        return -1;
+    }
+    id->device = static_cast<uint64_t>(info.st_dev);
+    id->inode = static_cast<uint64_t>(info.st_ino);
+    return 0;
+}
+
+int64_t io_file_mtime(HANDLE fd) {
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        return -1;
+    }
+    return static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+int io_datasync(HANDLE fd) {
+    return fdatasync(fd);
+}
+
+// Разделяемые области пула: начало области -> размер и объект разделяемой памяти под ней.
+// Страницы такой области io_map_alias показывает ещё по одному адресу
+struct SharedRegion {
+    size_t size;
+    int memory_fd;
+};
+std::mutex shared_regions_lock;
+std::map<uintptr_t, SharedRegion> shared_regions;
+
+// Объект разделяемой памяти без имени в файловой системе
+int create_shared_memory(size_t size) {
+#ifdef MFD_CLOEXEC
+    const int memory_fd = memfd_create("lab2-cache", MFD_CLOEXEC);
+#else
+    char name[64];
+    snprintf(name, sizeof(name), "/lab2-cache-%ld-%p", static_cast<long>(getpid()), static_cast<void*>(&name));
+    const int memory_fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (memory_fd >= 0) {
+        shm_unlink(name);
+    }
+#endif
+    if (memory_fd >= 0 && ftruncate(memory_fd, static_cast<off_t>(size)) != 0) {
+        close(memory_fd);
+        return -1;
+    }
+    return memory_fd;
+}
+
+// Размер области округляем до большой страницы во всех случаях,
+// чтобы io_release_region снимал отображение тем же размером
+void* io_reserve_region(size_t size, bool shareable) {
+    size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    if (shareable) {
+        // Обычные страницы: кадр блока должен отображаться отдельно от соседей
+        const int memory_fd = create_shared_memory(size);
+        if (memory_fd < 0) {
+            return nullptr;
+        }
+        void* region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0);
+        if (region == MAP_FAILED) {
+            close(memory_fd);
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> guard(shared_regions_lock);
+        shared_regions[reinterpret_cast<uintptr_t>(region)] = {size, memory_fd};
+        return region;
+    }
+#ifdef MAP_HUGETLB
+    // Явные большие страницы есть, только если администратор их зарезервировал
+    void* region = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (region != MAP_FAILED) {
+        return region;
+    }
+#endif
+    void* fallback = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (fallback == MAP_FAILED) {
+        return nullptr;
+    }
+#ifdef MADV_HUGEPAGE
+    // Иначе просим ядро собрать область из прозрачных больших страниц
+    madvise(fallback, size, MADV_HUGEPAGE);
+#endif
+    return fallback;
+}
+
+void io_release_region(void* region, size_t size) {
+    size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    munmap(region, size);
+    std::lock_guard<std::mutex> guard(shared_regions_lock);
+    const auto it = shared_regions.find(reinterpret_cast<uintptr_t>(region));
+    if (it != shared_regions.end()) {
+        close(it->second.memory_fd);
+        shared_regions.erase(it);
+    }
+}
+
+void* io_reserve_window(size_t size) {
+    void* window = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return window == MAP_FAILED ? nullptr : window;
+}
+
+// Показанные в окне страницы снимаются вместе с ним
+void io_release_window(void* window, size_t size) {
+    munmap(window, size);
+}
+
+int io_map_alias(void* target, const void* source, size_t size, bool writable) {
+    const uintptr_t address = reinterpret_cast<uintptr_t>(source);
+    int memory_fd = -1;
+    off_t offset = 0;
+    {
+        std::lock_guard<std::mutex> guard(shared_regions_lock);
+        auto it = shared_regions.upper_bound(address);
+        if (it != shared_regions.begin()) {
+            --it;
+            if (address + size <= it->first + it->second.size) {
+                memory_fd = it->second.memory_fd;
+                offset = static_cast<off_t>(address - it->first);
+            }
+        }
+    }
+    if (memory_fd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    void* mapped = mmap(target, size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                        MAP_SHARED | MAP_FIXED, memory_fd, offset);
+    return mapped == MAP_FAILED ? -1 : 0;
+}
+
+int io_last_error() {
+    return errno;
+}
+
+void io_set_invalid_handle() {
+    errno = EBADF;
+}
+
+void io_set_invalid_parameter() {
+    errno = EINVAL;
+}
+
+size_t io_map_granularity() {
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+unsigned long long io_tick_ms() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,271 @@
+#include "io_backend.h"
+#include <windows.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Открытие файла
+HANDLE io_open(const char* path) {
+    return CreateFile(
+        path,                           // Имя файла
+        GENERIC_READ | GENERIC_WRITE,   // Доступ на чтение и запись
+        FILE_SHARE_READ | FILE_SHARE_WRITE, // Файл можно открыть повторно (например, из другого потока)
+        NULL,                           // Без атрибутов безопасности
+        OPEN_EXISTING,                  // Открываем существующий файл
+        FILE_ATTRIBUTE_NORMAL,          // Обычные атрибуты файла
+        NULL                            // Без шаблона файла
+    );
+}
+
+int io_close(HANDLE fd) {
+    return CloseHandle(fd) ? 0 : -1;
+}
+
+// Смещение передаём через OVERLAPPED, чтобы не зависеть от указателя файла
+ptrdiff_t io_pread(HANDLE fd, void* buf, size_t count, int64_t offset) {
+    OVERLAPPED overlapped = {0};
+    overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+    DWORD bytesRead;
+    if (!ReadFile(fd, buf, static_cast<DWORD>(count), &bytesRead, &overlapped)) {
+        // Чтение за концом файла - не ошибка
+        if (GetLastError() == ERROR_HANDLE_EOF) {
+            return 0;
+        }
+        return -1;
+    }
+    return static_cast<ptrdiff_t>(bytesRead);
+}
+
+// ReadFileScatter и очереди завершения требуют асинхронного дескриптора без буферизации,
+// поэтому запросы пакета выполняются по очереди
+void io_read_batch(HANDLE fd, IoReadRequest* requests, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        requests[i].result = io_pread(fd, requests[i].data, requests[i].size, requests[i].offset);
+    }
+}
+
+void io_set_fixed_buffers(void* const*, const size_t*, size_t) {
+}
+
+ptrdiff_t io_pwrite(HANDLE fd, const void* buf, size_t count, int64_t offset) {
+    OVERLAPPED overlapped = {0};
+    overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+    DWORD bytesWritten;
+    if (!WriteFile(fd, buf, static_cast<DWORD>(count), &bytesWritten, &overlapped)) {
+        return -1;
+    }
+    return static_cast<ptrdiff_t>(bytesWritten);
+}
+
+// WriteFileGather требует асинхронного дескриптора без буферизации и сегментов по странице,
+// поэтому сегменты собираются в один буфер и пишутся одним вызовом WriteFile
+ptrdiff_t io_pwritev(HANDLE fd, const IoWriteSegment* segments, size_t count, int64_t offset) {
+    if (count == 1) {
+        return io_pwrite(fd, segments[0].data, segments[0].size, offset);
+    }
+    std::vector<char> staging;
+    for (size_t i = 0; i < count; ++i) {
+        const char* data = static_cast<const char*>(segments[i].data);
+        staging.insert(staging.end(), data, data + segments[i].size);
+    }
+    return io_pwrite(fd, staging.data(), staging.size(), offset);
+}
+
+int64_t io_file_size(HANDLE fd) {
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(fd, &size)) {
+        return -1;
+    }
+    return static_cast<int64_t>(size.QuadPart);
+}
+
+// Индекс файла уникален в пределах тома (на NTFS; у ReFS 128-битные индексы, их младшая половина)
+int io_file_id(HANDLE fd, IoFileId* id) {
+    BY_HANDLE_FILE_INFORMATION info;
+    if (!GetFileInformationByHandle(fd, &info)) {
+        return -1;
+    }
+    id->device = info.dwVolumeSerialNumber;
+    id->inode = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+    return 0;
+}
+
+// FILETIME считает интервалы по 100 нс от 1601 года
+int64_t io_file_mtime(HANDLE fd) {
+    FILETIME write_time;
+    if (!GetFileTime(fd, NULL, NULL, &write_time)) {
+        return -1;
+    }
+    const uint64_t ticks = (static_cast<uint64_t>(write_time.dwHighDateTime) << 32) | write_time.dwLowDateTime;
+    return (static_cast<int64_t>(ticks) - 116444736000000000LL) * 100;
+}
+
+int io_datasync(HANDLE fd) {
+    return FlushFileBuffers(fd) ? 0 : -1;
+}
+
+// Разделяемые области пула: начало области -> секция в файле подкачки под ней.
+// Страницы такой области io_map_alias показывает ещё по одному адресу
+struct SharedRegion {
+    size_t size;
+    HANDLE section;
+};
+std::mutex shared_regions_lock;
+std::map<uintptr_t, SharedRegion> shared_regions;
+
+void* io_reserve_region(size_t size, bool shareable) {
+    if (shareable) {
+        const ULONGLONG section_size = size;
+        HANDLE section = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                           static_cast<DWORD>(section_size >> 32),
+                                           static_cast<DWORD>(section_size & 0xFFFFFFFF), NULL);
+        if (section == NULL) {
+            return nullptr;
+        }
+        void* region = MapViewOfFile(section, FILE_MAP_ALL_ACCESS, 0, 0, size);
+        if (region == NULL) {
+            CloseHandle(section);
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> guard(shared_regions_lock);
+        shared_regions[reinterpret_cast<uintptr_t>(region)] = {size, section};
+        return region;
+    }
+    // Большие страницы доступны только при наличии привилегии SeLockMemoryPrivilege
+    const SIZE_T large_page = GetLargePageMinimum();
+    if (large_page != 0) {
+        const SIZE_T large_size = (size + large_page - 1) / large_page * large_page;
+        void* region = VirtualAlloc(NULL, large_size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (region) {
+            return region;
+        }
+    }
+    return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+void io_release_region(void* region, size_t) {
+    {
+        std::lock_guard<std::mutex> guard(shared_regions_lock);
+        const auto it = shared_regions.find(reinterpret_cast<uintptr_t>(region));
+        if (it != shared_regions.end()) {
+            UnmapViewOfFile(region);
+            CloseHandle(it->second.section);
+            shared_regions.erase(it);
+            return;
+        }
+    }
+    VirtualFree(region, 0, MEM_RELEASE);
+}
+
+// Окно строится из заполнителей (placeholder): в них отображение можно поставить по заданному адресу.
+// VirtualAlloc2 и MapViewOfFile3 есть начиная с Windows 10 1803, поэтому берутся из kernelbase.dll
+// во время работы; без них окна не создаются
+#ifdef MEM_RESERVE_PLACEHOLDER
+typedef PVOID (WINAPI *VirtualAlloc2Function)(HANDLE, PVOID, SIZE_T, ULONG, ULONG, void*, ULONG);
+typedef PVOID (WINAPI *MapViewOfFile3Function)(HANDLE, HANDLE, PVOID, ULONG64, SIZE_T, ULONG, ULONG, void*, ULONG);
+
+VirtualAlloc2Function virtual_alloc2() {
+    static const auto function = reinterpret_cast<VirtualAlloc2Function>(
+        GetProcAddress(GetModuleHandle("kernelbase.dll"), "VirtualAlloc2"));
+    return function;
+}
+
+MapViewOfFile3Function map_view_of_file3() {
+    static const auto function = reinterpret_cast<MapViewOfFile3Function>(
+        GetProcAddress(GetModuleHandle("kernelbase.dll"), "MapViewOfFile3"));
+    return function;
+}
+#endif
+
+void* io_reserve_window(size_t size) {
+#ifdef MEM_RESERVE_PLACEHOLDER
+    if (virtual_alloc2() != nullptr && map_view_of_file3() != nullptr) {
+        return virtual_alloc2()(GetCurrentProcess(), NULL, size, MEM_RESERVE | MEM_RESERVE_PLACEHOLDER,
+                                PAGE_NOACCESS, NULL, 0);
+    }
+#endif
+    (void) size;
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return nullptr;
+}
+
+// Окно разбито на отображения и оставшиеся заполнители - освобождаем каждый кусок
+void io_release_window(void* window, size_t size) {
+    char* address = static_cast<char*>(window);
+    char* const end = address + size;
+    while (address < end) {
+        MEMORY_BASIC_INFORMATION info;
+        if (VirtualQuery(address, &info, sizeof(info)) == 0) {
+            break;
+        }
+        if (info.Type == MEM_MAPPED) {
+            UnmapViewOfFile(address);
+        } else {
+            VirtualFree(address, 0, MEM_RELEASE);
+        }
+        address += info.RegionSize;
+    }
+}
+
+int io_map_alias(void* target, const void* source, size_t size, bool writable) {
+#ifdef MEM_RESERVE_PLACEHOLDER
+    const uintptr_t address = reinterpret_cast<uintptr_t>(source);
+    HANDLE section = NULL;
+    ULONG64 offset = 0;
+    {
+        std::lock_guard<std::mutex> guard(shared_regions_lock);
+        auto it = shared_regions.upper_bound(address);
+        if (it != shared_regions.begin()) {
+            --it;
+            if (address + size <= it->first + it->second.size) {
+                section = it->second.section;
+                offset = address - it->first;
+            }
+        }
+    }
+    if (section == NULL || map_view_of_file3() == nullptr) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+    // Отделяем от заполнителя кусок под отображение. Если заполнитель и так совпадает с ним, вызов
+    // завершается ошибкой, и это не мешает
+    VirtualFree(target, size, MEM_RELEASE | MEM_PRESERVE_PLACEHOLDER);
+    void* view = map_view_of_file3()(section, GetCurrentProcess(), target, offset, size, MEM_REPLACE_PLACEHOLDER,
+                                     writable ? PAGE_READWRITE : PAGE_READONLY, NULL, 0);
+    return view != NULL ? 0 : -1;
+#else
+    (void) target;
+    (void) source;
+    (void) size;
+    (void) writable;
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return -1;
+#endif
+}
+
+// MapViewOfFile3 принимает смещение в секции и адрес в заполнителе, кратные гранулярности выделения
+size_t io_map_granularity() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+}
+
+int io_last_error() {
+    return static_cast<int>(GetLastError());
+}
+
+void io_set_invalid_handle() {
+    SetLastError(ERROR_INVALID_HANDLE);
+}
+
+void io_set_invalid_parameter() {
+    SetLastError(ERROR_INVALID_PARAMETER);
+}
+
+unsigned long long io_tick_ms() {
+    return GetTickCount64();
+}